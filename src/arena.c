@@ -0,0 +1,128 @@
+// Implementations of the function declarations in arena.h.
+#include "arena.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A block of an arena; its memory follows the header.
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;                  // bytes after the header
+    alignas(max_align_t) unsigned char data[];
+} arena_block;
+
+// The blocks in use come first, the one being filled at their head; reset
+// blocks wait on spare until they are needed again.
+struct arena {
+    arena_block* blocks;
+    arena_block* spare;
+    size_t used;                  // bytes taken from the first block
+    size_t memory;
+};
+
+// Private helper rounding a size up to the alignment of every allocation;
+// returns 0 if the rounded size does not fit in a size_t.
+static size_t align_up(size_t size) {
+    size_t a = alignof(max_align_t);
+    if (size > SIZE_MAX - (a - 1)) { return 0; }
+    return (size + a - 1) / a * a;
+}
+
+arena* arena_create(void) {
+    arena* self = malloc(sizeof(arena));
+    if (self == NULL) { return NULL; }
+    self->blocks = NULL;
+    self->spare = NULL;
+    self->used = 0;
+    self->memory = 0;
+    return self;
+}
+
+// Private helper freeing a list of blocks.
+static void free_blocks(arena_block* b) {
+    while (b != NULL) {
+        arena_block* next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+void arena_destroy(arena* self) {
+    if (self == NULL) { return; }
+    free_blocks(self->blocks);
+    free_blocks(self->spare);
+    free(self);
+}
+
+// Private helper that starts a block of at least size bytes, the smallest
+// spare one that is big enough if there is one. A block of its own for a
+// large allocation goes behind the block being filled, which keeps its room.
+static void* new_block(arena* self, size_t size) {
+    arena_block** best = NULL;
+    for (arena_block** link = &self->spare; *link != NULL; link = &(*link)->next) {
+        if ((*link)->size >= size && (best == NULL || (*link)->size < (*best)->size)) best = link;
+    }
+    arena_block* b = best != NULL ? *best : NULL;
+    if (b != NULL) {
+        *best = b->next;
+    } else {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        if (block_size > SIZE_MAX - sizeof(arena_block)) { return NULL; }
+        b = malloc(sizeof(arena_block) + block_size);
+        if (b == NULL) { return NULL; }
+        b->size = block_size;
+        self->memory += sizeof(arena_block) + block_size;
+    }
+
+    if (size > ARENA_BLOCK_SIZE / 2 && self->blocks != NULL) {
+        b->next = self->blocks->next;
+        self->blocks->next = b;
+    } else {
+        b->next = self->blocks;
+        self->blocks = b;
+        self->used = size;
+    }
+    return b->data;
+}
+
+void* arena_alloc(arena* self, size_t size) {
+    size = align_up(size > 0 ? size : 1);
+    if (size == 0) { return NULL; }
+    arena_block* b = self->blocks;
+    if (b != NULL && b->size - self->used >= size) {
+        void* p = b->data + self->used;
+        self->used += size;
+        return p;
+    }
+    return new_block(self, size);
+}
+
+void* arena_calloc(arena* self, size_t count, size_t size) {
+    if (size > 0 && count > SIZE_MAX / size) { return NULL; }
+    void* p = arena_alloc(self, count * size);
+    if (p != NULL) memset(p, 0, count * size);
+    return p;
+}
+
+void* arena_copy(arena* self, const void* data, size_t size) {
+    void* p = arena_alloc(self, size);
+    if (p != NULL) memcpy(p, data, size);
+    return p;
+}
+
+void arena_reset(arena* self) {
+    arena_block* b = self->blocks;
+    while (b != NULL) {
+        arena_block* next = b->next;
+        b->next = self->spare;
+        self->spare = b;
+        b = next;
+    }
+    self->blocks = NULL;
+    self->used = 0;
+}
+
+size_t arena_memory(arena* self) {
+    return self->memory;
+}
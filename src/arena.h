@@ -0,0 +1,99 @@
+/**
+ * This header provides a region (arena) allocator.
+ *
+ * An arena hands out memory by bumping a pointer through blocks it takes
+ * from malloc, and gives all of it back at once: arena_reset to reuse the
+ * blocks, arena_destroy to free them. Nothing allocated from an arena is
+ * freed on its own. Memory that belongs together and dies together, such
+ * as everything parsed from one map or the search state of one worker, then
+ * costs a handful of malloc calls however many pieces it is made of.
+ *
+ * An arena belongs to one thread at a time.
+ */
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bytes in a block, unless a single allocation needs more.
+#ifndef ARENA_BLOCK_SIZE
+#define ARENA_BLOCK_SIZE 65536
+#endif
+
+/**
+ * Forward declared arena struct, hiding implementation details.
+ */
+typedef struct arena arena;
+
+/**
+ * Creates an empty arena.
+ *
+ * @return the arena, or NULL if memory allocation failed
+ */
+arena* arena_create(void);
+
+/**
+ * Frees an arena and everything allocated from it.
+ *
+ * @param self the arena being deallocated, or NULL
+ */
+void arena_destroy(arena* self);
+
+/**
+ * Allocates memory from an arena, aligned for any type. An allocation larger
+ * than half of ARENA_BLOCK_SIZE gets a block of its own.
+ *
+ * Runtime: O(1)
+ *
+ * @param  self the arena
+ * @param  size the number of bytes wanted
+ * @return      the memory, or NULL if memory allocation failed or size is
+ *              too large to allocate
+ */
+void* arena_alloc(arena* self, size_t size);
+
+/**
+ * arena_alloc for count elements of size bytes each, zeroed.
+ *
+ * Runtime: O(count * size)
+ *
+ * @param  self  the arena
+ * @param  count the number of elements
+ * @param  size  the size of each
+ * @return       the memory, or NULL if memory allocation failed or the size
+ *               overflows
+ */
+void* arena_calloc(arena* self, size_t count, size_t size);
+
+/**
+ * Copies bytes into an arena.
+ *
+ * @param  self the arena
+ * @param  data the bytes to copy
+ * @param  size the number of bytes
+ * @return      the copy, or NULL if memory allocation failed
+ */
+void* arena_copy(arena* self, const void* data, size_t size);
+
+/**
+ * Forgets everything allocated from an arena but keeps its blocks, so that
+ * the next allocations up to the same total are served without malloc.
+ *
+ * Runtime: O(blocks)
+ *
+ * @param self the arena
+ */
+void arena_reset(arena* self);
+
+/**
+ * Returns the bytes an arena holds in blocks, used or not.
+ *
+ * Runtime: O(1)
+ *
+ * @param  self the arena
+ * @return      its size in bytes
+ */
+size_t arena_memory(arena* self);
+
+#endif//__ARENA_H__
@@ -0,0 +1,476 @@
+// Implementations of the function declarations in batch.h.
+#include "batch.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Where a slot of the window is in its life.
+typedef enum slot_state {
+    SLOT_EMPTY,     // free for the next trip
+    SLOT_QUEUED,    // submitted, or taken by a worker
+    SLOT_DONE       // answered, waiting to be written
+} slot_state;
+
+// One trip in flight and its answer.
+typedef struct slot {
+    trip_record trip;
+    batch_text text;
+    bool ok;
+    slot_state state;
+} slot;
+
+// The trips waiting for one worker, by number, oldest at head. The owner
+// takes from the head and thieves from the tail, so they only meet on the
+// last trip.
+typedef struct deque {
+    pthread_mutex_t lock;
+    size_t* trips;          // ring of window entries
+    size_t head;
+    atomic_size_t count;    // read without the lock to pick a victim
+} deque;
+
+// A worker thread, its trips and what it did.
+typedef struct worker {
+    struct batch* owner;
+    size_t index;
+    pthread_t thread;
+    deque queue;
+    batch_worker_stats stats;
+} worker;
+
+// Trip number k lives in slots[k % window]. The trips from written up to
+// submitted are in flight, and pending of them are in a deque or on their
+// way into one.
+struct batch {
+    batch_task task;
+    FILE* out;
+    bool flush_each;
+    slot* slots;
+    size_t window;
+    size_t submitted;
+    size_t written;
+    size_t next_worker;     // deque the next trip goes to
+    atomic_size_t pending;
+    bool writing;           // a worker is writing answers
+    bool closing;           // no more trips are coming
+    atomic_bool failed;     // an answer failed
+    bool cut;               // the output stopped at an answer that failed
+    size_t idle;            // workers waiting for a trip
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // a trip was submitted, or the batch is closing
+    pthread_cond_t space;   // a slot was written, or an answer failed
+    worker* workers;
+    size_t thread_count;
+    void* state;            // state of the calling thread, with no workers
+    double started;
+    double seconds;         // from batch_create to batch_finish
+};
+
+// Private helper returning a monotonic clock in seconds.
+static double seconds_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+bool batch_printf(batch_text* self, const char* format, ...) {
+    va_list args;
+    while (true) {
+        va_start(args, format);
+        size_t room = self->capacity - self->size;
+        char* at = self->data != NULL ? self->data + self->size : NULL;
+        int length = vsnprintf(at, room, format, args);
+        va_end(args);
+        if (length < 0) { return false; }
+        if ((size_t)length < room) {
+            self->size += length;
+            return true;
+        }
+        size_t cap = self->capacity > 0 ? self->capacity : 256;
+        while (cap - self->size <= (size_t)length) cap *= 2;
+        char* data = realloc(self->data, cap);
+        if (data == NULL) { return false; }
+        self->data = data;
+        self->capacity = cap;
+    }
+}
+
+// Private helper that adds trip k at the tail of a deque. It never
+// overflows: a deque holds window entries and at most window trips are in
+// flight.
+static void deque_push(deque* D, size_t window, size_t k) {
+    pthread_mutex_lock(&D->lock);
+    size_t count = atomic_load(&D->count);
+    D->trips[(D->head + count) % window] = k;
+    atomic_store(&D->count, count + 1);
+    pthread_mutex_unlock(&D->lock);
+}
+
+// Private helper that takes the oldest trip of a deque, or the newest when
+// stealing; returns false if it was empty.
+static bool deque_take(deque* D, size_t window, bool steal, size_t* k) {
+    pthread_mutex_lock(&D->lock);
+    size_t count = atomic_load(&D->count);
+    if (count > 0) {
+        if (steal) {
+            *k = D->trips[(D->head + count - 1) % window];
+        } else {
+            *k = D->trips[D->head];
+            D->head = (D->head + 1) % window;
+        }
+        atomic_store(&D->count, count - 1);
+    }
+    pthread_mutex_unlock(&D->lock);
+    return count > 0;
+}
+
+// Private helper that takes the oldest trip of a worker's own deque that its
+// state prefers, among the first BATCH_WINDOW, or else the oldest trip.
+static bool deque_take_preferred(batch* self, deque* D, void* state, size_t* k) {
+    pthread_mutex_lock(&D->lock);
+    size_t count = atomic_load(&D->count);
+    size_t scan = count < BATCH_WINDOW ? count : BATCH_WINDOW;
+    size_t pick = 0;
+    for (size_t i = 0; state != NULL && i < scan; i++) {
+        size_t trip = D->trips[(D->head + i) % self->window];
+        if (self->task.prefer(self->task.context, state, &self->slots[trip % self->window].trip)) {
+            pick = i;
+            break;
+        }
+    }
+    if (count > 0) {
+        *k = D->trips[(D->head + pick) % self->window];
+        // close the gap, keeping the rest in order
+        for (size_t i = pick; i > 0; i--) {
+            D->trips[(D->head + i) % self->window] = D->trips[(D->head + i - 1) % self->window];
+        }
+        D->head = (D->head + 1) % self->window;
+        atomic_store(&D->count, count - 1);
+    }
+    pthread_mutex_unlock(&D->lock);
+    return count > 0;
+}
+
+// Private helper, called with the lock held, that writes the completed
+// answers from the oldest unwritten trip on. Only one worker writes at a
+// time; one that completes a trip while another writes leaves it to that
+// writer, which looks again after every answer.
+static void write_ready(batch* self) {
+    if (self->writing) { return; }
+    self->writing = true;
+    while (true) {
+        size_t run = 0;
+        while (self->written < self->submitted
+                && self->slots[self->written % self->window].state == SLOT_DONE) {
+            slot* s = &self->slots[self->written % self->window];
+            if (!s->ok) self->cut = true;
+            bool write = !self->cut;
+            pthread_mutex_unlock(&self->lock);
+            if (write && s->text.size > 0) {
+                fwrite(s->text.data, 1, s->text.size, self->out);
+            }
+            pthread_mutex_lock(&self->lock);
+            s->state = SLOT_EMPTY;
+            self->written++;
+            run++;
+            pthread_cond_broadcast(&self->space);
+        }
+        if (run == 0 || !self->flush_each) { break; }
+        pthread_mutex_unlock(&self->lock);
+        fflush(self->out);
+        pthread_mutex_lock(&self->lock);
+    }
+    self->writing = false;
+}
+
+// Private helper that finds a trip for worker W: one of its own, or else the
+// newest of the worker with the most waiting. Returns false once
+// no trip is pending.
+static bool find_trip(worker* W, void* state, size_t* k) {
+    batch* self = W->owner;
+    while (atomic_load(&self->pending) > 0) {
+        if (self->task.prefer != NULL
+                ? deque_take_preferred(self, &W->queue, state, k)
+                : deque_take(&W->queue, self->window, false, k)) {
+            return true;
+        }
+        worker* victim = NULL;
+        size_t most = 0;
+        for (size_t i = 1; i < self->thread_count; i++) {
+            worker* other = &self->workers[(W->index + i) % self->thread_count];
+            size_t count = atomic_load(&other->queue.count);
+            if (count > most) {
+                most = count;
+                victim = other;
+            }
+        }
+        if (victim != NULL && deque_take(&victim->queue, self->window, true, k)) {
+            W->stats.stolen++;
+            return true;
+        }
+        // whatever is pending is being taken, or on its way into a deque
+        sched_yield();
+    }
+    return false;
+}
+
+// Private helper that runs one worker thread until the batch closes.
+static void* work(void* arg) {
+    worker* W = arg;
+    batch* self = W->owner;
+    void* state = self->task.create(self->task.context);
+    if (state == NULL) {
+        pthread_mutex_lock(&self->lock);
+        atomic_store(&self->failed, true);
+        pthread_cond_broadcast(&self->space);
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    while (true) {
+        size_t k;
+        if (!find_trip(W, state, &k)) {
+            pthread_mutex_lock(&self->lock);
+            while (atomic_load(&self->pending) == 0 && !self->closing) {
+                self->idle++;
+                pthread_cond_wait(&self->work, &self->lock);
+                self->idle--;
+            }
+            bool done = atomic_load(&self->pending) == 0;
+            pthread_mutex_unlock(&self->lock);
+            if (done) { break; }
+            continue;
+        }
+        atomic_fetch_sub(&self->pending, 1);
+
+        // once an answer failed the rest are only marked done, so that
+        // waiting for them still ends
+        slot* s = &self->slots[k % self->window];
+        s->text.size = 0;
+        double started = seconds_now();
+        bool ok = !atomic_load(&self->failed)
+            && self->task.answer(self->task.context, state, &s->trip, &s->text);
+        W->stats.busy_seconds += seconds_now() - started;
+        W->stats.trips++;
+
+        pthread_mutex_lock(&self->lock);
+        s->ok = ok;
+        s->state = SLOT_DONE;
+        if (!ok && !atomic_load(&self->failed)) {
+            atomic_store(&self->failed, true);
+            pthread_cond_broadcast(&self->space);
+        }
+        write_ready(self);
+        pthread_mutex_unlock(&self->lock);
+    }
+
+    if (state != NULL) self->task.destroy(self->task.context, state);
+    return NULL;
+}
+
+// Private helper for a batch answered on the calling thread that answers
+// the trips held back, each time the oldest one the state prefers or else
+// the oldest, then writes them in order.
+static bool drain_inline(batch* self) {
+    worker* W = &self->workers[0];
+    for (size_t left = self->submitted - self->written; left > 0 && !atomic_load(&self->failed); left--) {
+        slot* pick = NULL;
+        for (size_t k = self->written; k < self->submitted; k++) {
+            slot* s = &self->slots[k % self->window];
+            if (s->state != SLOT_QUEUED) continue;
+            if (pick == NULL) pick = s;
+            if (self->task.prefer != NULL && self->task.prefer(self->task.context, self->state, &s->trip)) {
+                pick = s;
+                break;
+            }
+        }
+        pick->text.size = 0;
+        double started = seconds_now();
+        pick->ok = self->task.answer(self->task.context, self->state, &pick->trip, &pick->text);
+        pick->state = SLOT_DONE;
+        W->stats.busy_seconds += seconds_now() - started;
+        W->stats.trips++;
+        if (!pick->ok) atomic_store(&self->failed, true);
+    }
+
+    for (; self->written < self->submitted; self->written++) {
+        slot* s = &self->slots[self->written % self->window];
+        if (s->state != SLOT_DONE || !s->ok) self->cut = true;
+        if (!self->cut && s->text.size > 0) {
+            fwrite(s->text.data, 1, s->text.size, self->out);
+        }
+        s->state = SLOT_EMPTY;
+    }
+    if (self->flush_each) fflush(self->out);
+    return !atomic_load(&self->failed);
+}
+
+batch* batch_create(const batch_task* task, size_t threads, FILE* out, bool flush_each) {
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+    if (threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+
+    batch* self = calloc(1, sizeof(batch));
+    if (self == NULL) { return NULL; }
+    self->task = *task;
+    self->out = out;
+    self->flush_each = flush_each;
+    self->window = threads * BATCH_WINDOW;
+    self->started = seconds_now();
+    self->slots = calloc(self->window, sizeof(slot));
+    self->workers = calloc(threads, sizeof(worker));
+    bool ok = self->slots != NULL && self->workers != NULL;
+    for (size_t i = 0; ok && i < threads; i++) {
+        self->workers[i].queue.trips = malloc(self->window * sizeof(size_t));
+        ok = self->workers[i].queue.trips != NULL;
+    }
+    if (!ok) {
+        for (size_t i = 0; self->workers != NULL && i < threads; i++) {
+            free(self->workers[i].queue.trips);
+        }
+        free(self->slots);
+        free(self->workers);
+        free(self);
+        return NULL;
+    }
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->work, NULL);
+    pthread_cond_init(&self->space, NULL);
+    for (size_t i = 0; i < threads; i++) {
+        self->workers[i].owner = self;
+        self->workers[i].index = i;
+        pthread_mutex_init(&self->workers[i].queue.lock, NULL);
+    }
+
+    // a single worker would only take turns with the calling thread, so the
+    // calling thread answers the trips instead, as they are submitted or,
+    // when some are preferred, a window at a time
+    if (threads == 1) {
+        self->thread_count = 1;
+        self->state = task->create(task->context);
+        if (self->state == NULL) {
+            self->closing = true;
+            batch_destroy(self);
+            return NULL;
+        }
+        return self;
+    }
+
+    // run with however many threads could be started
+    while (self->thread_count < threads
+            && pthread_create(&self->workers[self->thread_count].thread, NULL, work,
+                &self->workers[self->thread_count]) == 0) {
+        self->thread_count++;
+    }
+    for (size_t i = self->thread_count; i < threads; i++) {
+        pthread_mutex_destroy(&self->workers[i].queue.lock);
+        free(self->workers[i].queue.trips);
+    }
+    if (self->thread_count == 0) {
+        batch_destroy(self);
+        return NULL;
+    }
+    return self;
+}
+
+bool batch_submit(batch* self, const trip_record* trip) {
+    if (self->state != NULL) {
+        slot* s = &self->slots[self->submitted % self->window];
+        s->trip = *trip;
+        s->state = SLOT_QUEUED;
+        self->submitted++;
+        // only trips that may be taken out of order are worth holding back
+        if (self->task.prefer == NULL || self->flush_each || self->submitted - self->written == self->window) {
+            return drain_inline(self);
+        }
+        return true;
+    }
+
+    pthread_mutex_lock(&self->lock);
+    while (self->submitted - self->written == self->window && !atomic_load(&self->failed)) {
+        pthread_cond_wait(&self->space, &self->lock);
+    }
+    bool ok = !atomic_load(&self->failed);
+    size_t k = self->submitted;
+    bool wake = false;
+    if (ok) {
+        slot* s = &self->slots[k % self->window];
+        s->trip = *trip;
+        s->state = SLOT_QUEUED;
+        self->submitted++;
+        // counted before it is queued, so that pending never runs short
+        atomic_fetch_add(&self->pending, 1);
+        wake = self->idle > 0;
+    }
+    pthread_mutex_unlock(&self->lock);
+    if (!ok) { return false; }
+
+    // deal the trips out by group, or in turn; stealing evens out what that
+    // gets wrong
+    size_t to = self->next_worker;
+    if (self->task.prefer != NULL) {
+        size_t group = trip->start * 2 + (trip->type == 'T');
+        to = (size_t)((group * 0x9E3779B97F4A7C15ull) >> 32) % self->thread_count;
+    } else {
+        self->next_worker = (self->next_worker + 1) % self->thread_count;
+    }
+    deque_push(&self->workers[to].queue, self->window, k);
+    if (wake) pthread_cond_signal(&self->work);
+    return true;
+}
+
+bool batch_finish(batch* self) {
+    pthread_mutex_lock(&self->lock);
+    self->closing = true;
+    pthread_cond_broadcast(&self->work);
+    pthread_mutex_unlock(&self->lock);
+
+    // a worker only stops once no trip is pending, and the last to complete
+    // one writes whatever was still waiting
+    if (self->state == NULL) {
+        for (size_t i = 0; i < self->thread_count; i++) {
+            pthread_join(self->workers[i].thread, NULL);
+        }
+    } else {
+        drain_inline(self);
+    }
+    self->seconds = seconds_now() - self->started;
+    return !atomic_load(&self->failed);
+}
+
+size_t batch_threads(batch* self) {
+    return self->thread_count;
+}
+
+batch_worker_stats batch_stats(batch* self, size_t worker) {
+    batch_worker_stats stats = self->workers[worker].stats;
+    stats.utilization = self->seconds > 0 ? stats.busy_seconds / self->seconds : 0.0;
+    return stats;
+}
+
+double batch_seconds(batch* self) {
+    return self->seconds;
+}
+
+void batch_destroy(batch* self) {
+    if (!self->closing) batch_finish(self);
+    if (self->state != NULL) self->task.destroy(self->task.context, self->state);
+    for (size_t i = 0; i < self->thread_count; i++) {
+        pthread_mutex_destroy(&self->workers[i].queue.lock);
+        free(self->workers[i].queue.trips);
+    }
+    for (size_t k = 0; k < self->window; k++) {
+        free(self->slots[k].text.data);
+    }
+    pthread_cond_destroy(&self->space);
+    pthread_cond_destroy(&self->work);
+    pthread_mutex_destroy(&self->lock);
+    free(self->slots);
+    free(self->workers);
+    free(self);
+}
@@ -0,0 +1,161 @@
+/**
+ * This header provides a batch engine that answers trips on several threads.
+ *
+ * The reading thread submits trips in input order into a bounded window and
+ * deals them out to per-worker deques. A worker answers the oldest trip of
+ * its own deque into the text buffer of its slot, using search state of its
+ * own that is created once and reused for every trip it answers.
+ *
+ * A task that can answer some trips cheaper with the state the last one left
+ * behind, such as trips from the same start, says so through prefer. Trips
+ * are then dealt by start and metric, so that each such group goes to one
+ * worker, and a worker takes the oldest trip its state prefers before the
+ * oldest trip. Otherwise trips are dealt in turn.
+ *
+ * A worker whose deque is empty steals the newest trip of the
+ * worker with the most waiting, so a few long trips dealt to one worker do
+ * not leave the others idle. Whichever worker completes the oldest unwritten
+ * trip writes it, and every completed trip right after it, so answers come
+ * out in the order the trips went in.
+ *
+ * The window holds BATCH_WINDOW trips per worker. A reader that gets ahead
+ * of the workers, or workers that get ahead of a slow trip, wait for room
+ * rather than letting the buffered answers grow without bound. A batch of
+ * one answers on the calling thread: each trip as it is submitted, or, for a
+ * task with prefer and output that is not flushed per answer, a window at a
+ * time in preferred order.
+ */
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+#include "parser.h"
+
+// Most worker threads a batch starts.
+#define BATCH_MAX_THREADS 64
+
+// Trips in flight per worker thread.
+#ifndef BATCH_WINDOW
+#define BATCH_WINDOW 64
+#endif
+
+/**
+ * A growable text buffer an answer is written into.
+ */
+typedef struct batch_text
+{
+    char* data;       // the text, NUL terminated once anything was written
+    size_t size;      // its length in bytes
+    size_t capacity;  // allocated length of data
+} batch_text;
+
+/**
+ * What a batch does with each trip. Every function is called on a worker
+ * thread with the same context, so whatever they share through it must only
+ * be read while the batch runs.
+ */
+typedef struct batch_task
+{
+    // creates the state of one worker, or returns NULL if out of memory
+    void* (*create)(void* context);
+    // answers trip into out with state; false if out of memory
+    bool (*answer)(void* context, void* state, const trip_record* trip, batch_text* out);
+    // frees the state of one worker
+    void (*destroy)(void* context, void* state);
+    // whether state answers trip cheaper than other trips; may be NULL
+    bool (*prefer)(void* context, void* state, const trip_record* trip);
+    void* context;
+} batch_task;
+
+/**
+ * What one worker of a batch did.
+ */
+typedef struct batch_worker_stats
+{
+    size_t trips;          // trips answered
+    size_t stolen;         // of those, taken from another worker's deque
+    double busy_seconds;   // time spent answering
+    double utilization;    // busy_seconds over the life of the batch
+} batch_worker_stats;
+
+/**
+ * Forward declared batch struct, hiding implementation details.
+ */
+typedef struct batch batch;
+
+/**
+ * Appends formatted text to an answer.
+ *
+ * @param  self   the answer
+ * @param  format a printf format
+ * @return        true, or false if memory allocation failed
+ */
+bool batch_printf(batch_text* self, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Starts the worker threads of a batch.
+ *
+ * @param  task       what to do with each trip
+ * @param  threads    the number of workers, 0 for one per online core; at
+ *                    most BATCH_MAX_THREADS are started
+ * @param  out        where the answers are written
+ * @param  flush_each whether out is flushed after every run of answers
+ *                    written, for a reader waiting on each answer
+ * @return            the batch, or NULL if memory allocation failed or no
+ *                    thread could be started
+ */
+batch* batch_create(const batch_task* task, size_t threads, FILE* out, bool flush_each);
+
+/**
+ * Hands a trip to the workers, waiting while the window is full.
+ *
+ * @param  self the batch
+ * @param  trip the next trip in input order
+ * @return      true, or false if an earlier answer failed, in which case no
+ *              more trips are taken
+ */
+bool batch_submit(batch* self, const trip_record* trip);
+
+/**
+ * Waits until every submitted trip is answered and written, then stops the
+ * workers. Answers after one that failed are not written.
+ *
+ * @param  self the batch
+ * @return      true if every answer succeeded
+ */
+bool batch_finish(batch* self);
+
+/**
+ * Returns the number of worker threads of a batch.
+ *
+ * @param  self the batch
+ * @return      the number of workers, 1 when the calling thread answers
+ */
+size_t batch_threads(batch* self);
+
+/**
+ * Returns what a worker of a finished batch did.
+ *
+ * @param  self   the batch, after batch_finish
+ * @param  worker a worker, less than batch_threads(self)
+ * @return        the trips it answered and the time it was busy
+ */
+batch_worker_stats batch_stats(batch* self, size_t worker);
+
+/**
+ * Returns the seconds from batch_create to batch_finish.
+ *
+ * @param  self the batch, after batch_finish
+ * @return      its life in seconds
+ */
+double batch_seconds(batch* self);
+
+/**
+ * Frees all memory associated with a batch. Call batch_finish first.
+ *
+ * @param self the batch being deallocated
+ */
+void batch_destroy(batch* self);
+
+#endif//__BATCH_H__
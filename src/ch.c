@@ -0,0 +1,746 @@
+// Implementations of the function declarations in ch.h.
+#include "ch.h"
+#include "arena.h"
+#include "graph_lib.h"
+#include "pqueue.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// A growable list of arcs, one per vertex and direction while contracting.
+typedef struct arc_list {
+    size_t size;
+    size_t capacity;
+    ch_arc* arcs;
+} arc_list;
+
+// State of the contraction. out[v] and in[v] hold the arcs between v and the
+// vertices that are not yet contracted; once v is contracted its own lists
+// are frozen, and they are exactly its upward and downward arcs.
+typedef struct contraction {
+    size_t n;
+    arc_list* out;
+    arc_list* in;
+    size_t* contracted_neighbors;
+    size_t shortcut_count;
+
+    // Witness search workspace, reset through the touched list; target marks
+    // the vertices the search is for
+    double* witness;
+    bool* target;
+    vertex_t* touched;
+    size_t touched_count;
+    pqueue queue;
+} contraction;
+
+// Private helper reading a monotonic clock in seconds.
+static double seconds_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Private helper that appends an arc to a list.
+static bool list_add(arc_list* list, ch_arc arc) {
+    if (list->size == list->capacity) {
+        size_t new_cap = list->capacity > 0 ? 2 * list->capacity : 4;
+        ch_arc* arcs = realloc(list->arcs, new_cap * sizeof(ch_arc));
+        if (arcs == NULL) { return false; }
+        list->arcs = arcs;
+        list->capacity = new_cap;
+    }
+    list->arcs[list->size++] = arc;
+    return true;
+}
+
+// Private helper returning the arc of a list that leads to v, or NULL.
+static ch_arc* list_find(arc_list* list, vertex_t v) {
+    for (size_t i = 0; i < list->size; i++) {
+        if (list->arcs[i].to == v) { return &list->arcs[i]; }
+    }
+    return NULL;
+}
+
+// Private helper that removes the arc leading to v from a list.
+static void list_remove(arc_list* list, vertex_t v) {
+    ch_arc* arc = list_find(list, v);
+    if (arc != NULL) {
+        *arc = list->arcs[--list->size];
+    }
+}
+
+// Private helper that adds the arc u->x, or lowers its weight if it is
+// already present with a larger one.
+static bool add_arc(contraction* C, vertex_t u, vertex_t x, double weight, vertex_t middle) {
+    ch_arc* forward = list_find(&C->out[u], x);
+    if (forward != NULL) {
+        if (forward->weight > weight) {
+            ch_arc* backward = list_find(&C->in[x], u);
+            forward->weight = backward->weight = weight;
+            forward->middle = backward->middle = middle;
+        }
+        return true;
+    }
+    ch_arc out_arc = { x, weight, middle };
+    ch_arc in_arc = { u, weight, middle };
+    return list_add(&C->out[u], out_arc) && list_add(&C->in[x], in_arc);
+}
+
+// Private helper running a witness search: Dijkstra from u among the
+// remaining vertices other than skip, until all targets are settled, every
+// vertex within limit is, or CH_WITNESS_LIMIT vertices are. Distances are
+// left in witness.
+static bool witness_search(contraction* C, vertex_t u, vertex_t skip, double limit, size_t targets) {
+    for (size_t i = 0; i < C->touched_count; i++) C->witness[C->touched[i]] = INFINITY;
+    C->touched_count = 0;
+    pqueue_clear(&C->queue);
+
+    C->witness[u] = 0.0;
+    C->touched[C->touched_count++] = u;
+    if (pqueue_push(&C->queue, u, 0.0) == NULL) { return false; }
+
+    size_t settled = 0;
+    vertex_t current;
+    double current_dist;
+    while (pqueue_top(&C->queue, &current, &current_dist) != NULL
+            && current_dist <= limit && settled < CH_WITNESS_LIMIT && targets > 0) {
+        pqueue_pop(&C->queue);
+        settled++;
+        if (C->target[current]) targets--;
+        arc_list* out = &C->out[current];
+        for (size_t i = 0; i < out->size; i++) {
+            vertex_t x = out->arcs[i].to;
+            if (x == skip) { continue; }
+            double d = current_dist + out->arcs[i].weight;
+            if (d < C->witness[x]) {
+                if (C->witness[x] == INFINITY) C->touched[C->touched_count++] = x;
+                C->witness[x] = d;
+                bool queued = pqueue_contains(&C->queue, x)
+                    ? pqueue_adjust_priority(&C->queue, x, d) != NULL
+                    : pqueue_push(&C->queue, x, d) != NULL;
+                if (!queued) { return false; }
+            }
+        }
+    }
+    return true;
+}
+
+// Private helper that contracts v, or with apply false only counts the
+// shortcuts contracting v would need.
+static bool contract(contraction* C, vertex_t v, bool apply, size_t* shortcuts) {
+    arc_list* in = &C->in[v];
+    arc_list* out = &C->out[v];
+    *shortcuts = 0;
+
+    for (size_t i = 0; i < in->size; i++) {
+        vertex_t u = in->arcs[i].to;
+        double to_v = in->arcs[i].weight;
+
+        double limit = 0.0;
+        size_t targets = 0;
+        for (size_t j = 0; j < out->size; j++) {
+            if (out->arcs[j].to != u) {
+                C->target[out->arcs[j].to] = true;
+                targets++;
+                if (to_v + out->arcs[j].weight > limit) limit = to_v + out->arcs[j].weight;
+            }
+        }
+        bool searched = witness_search(C, u, v, limit, targets);
+        for (size_t j = 0; j < out->size; j++) C->target[out->arcs[j].to] = false;
+        if (!searched) { return false; }
+
+        for (size_t j = 0; j < out->size; j++) {
+            vertex_t x = out->arcs[j].to;
+            double via_v = to_v + out->arcs[j].weight;
+            if (x == u || C->witness[x] <= via_v) { continue; }
+            (*shortcuts)++;
+            if (apply && !add_arc(C, u, x, via_v, v)) { return false; }
+        }
+    }
+
+    if (apply) {
+        // Detach v from the remaining graph; its own lists stay as they are.
+        C->shortcut_count += *shortcuts;
+        for (size_t i = 0; i < in->size; i++) {
+            list_remove(&C->out[in->arcs[i].to], v);
+            C->contracted_neighbors[in->arcs[i].to]++;
+        }
+        for (size_t j = 0; j < out->size; j++) {
+            list_remove(&C->in[out->arcs[j].to], v);
+            C->contracted_neighbors[out->arcs[j].to]++;
+        }
+    }
+    return true;
+}
+
+// Private helper computing the contraction priority of v; lower goes first.
+static bool priority(contraction* C, vertex_t v, double* value) {
+    size_t shortcuts;
+    if (!contract(C, v, false, &shortcuts)) { return false; }
+    double removed = (double)(C->in[v].size + C->out[v].size);
+    *value = (double)shortcuts - removed + (double)C->contracted_neighbors[v];
+    return true;
+}
+
+// Private helper that packs the frozen lists into one CSR array per direction.
+static bool pack(arc_list* lists, size_t n, size_t** offset, ch_arc** arcs) {
+    *offset = malloc((n + 1) * sizeof(size_t));
+    if (*offset == NULL) { return false; }
+    (*offset)[0] = 0;
+    for (size_t v = 0; v < n; v++) (*offset)[v + 1] = (*offset)[v] + lists[v].size;
+    *arcs = malloc(((*offset)[n] + 1) * sizeof(ch_arc));
+    if (*arcs == NULL) { return false; }
+    for (size_t v = 0; v < n; v++) {
+        // a vertex without arcs may never have had its list allocated
+        if (lists[v].size > 0) memcpy(*arcs + (*offset)[v], lists[v].arcs, lists[v].size * sizeof(ch_arc));
+    }
+    return true;
+}
+
+// Private helper freeing the contraction state.
+static void contraction_destroy(contraction* C) {
+    for (size_t v = 0; C->out != NULL && v < C->n; v++) free(C->out[v].arcs);
+    for (size_t v = 0; C->in != NULL && v < C->n; v++) free(C->in[v].arcs);
+    free(C->out);
+    free(C->in);
+    free(C->contracted_neighbors);
+    free(C->witness);
+    free(C->target);
+    free(C->touched);
+    pqueue_destroy(&C->queue);
+}
+
+ch* ch_create(graph* G, char metric) {
+    double started = seconds_now();
+    size_t n = graph_vertex_count(G);
+
+    ch* self = calloc(1, sizeof(ch));
+    if (self == NULL) { return NULL; }
+    self->n = n;
+    self->metric = metric;
+    self->rank = malloc((n + 1) * sizeof(size_t));
+
+    contraction C;
+    C.n = n;
+    C.out = calloc(n + 1, sizeof(arc_list));
+    C.in = calloc(n + 1, sizeof(arc_list));
+    C.contracted_neighbors = calloc(n + 1, sizeof(size_t));
+    C.shortcut_count = 0;
+    C.witness = malloc((n + 1) * sizeof(double));
+    C.target = calloc(n + 1, sizeof(bool));
+    C.touched = malloc((n + 1) * sizeof(vertex_t));
+    C.touched_count = 0;
+    pqueue_init(&C.queue);
+    bool ok = self->rank != NULL && C.out != NULL && C.in != NULL
+        && C.contracted_neighbors != NULL && C.witness != NULL && C.target != NULL && C.touched != NULL
+        && pqueue_reserve(&C.queue, n) != NULL;
+    for (size_t v = 0; ok && v < n; v++) C.witness[v] = INFINITY;
+
+    // Copy the map's edges, weighed by the metric
+    for (vertex_t u = 0; ok && u < n; u++) {
+        const vertex_t* neighbors;
+        const double* lengths;
+        const double* speeds;
+        size_t deg = 0;
+        graph_out_edges(G, u, &neighbors, &lengths, &speeds, &deg);
+        for (size_t i = 0; ok && i < deg; i++) {
+            if (neighbors[i] != u) {
+                double w = graph_metric_cost(lengths[i], speeds[i], metric);
+                ok = add_arc(&C, u, neighbors[i], w, CH_NO_MIDDLE);
+            }
+        }
+    }
+    for (vertex_t v = 0; ok && v < n; v++) self->edge_count += C.out[v].size;
+
+    // Contract in priority order. A popped vertex whose priority has grown
+    // past the next one is put back (lazy updates). Neighbors of a contracted
+    // vertex are left to be caught this way too; recomputing them eagerly
+    // cost four times as long for the same number of shortcuts.
+    pqueue order;
+    pqueue_init(&order);
+    ok = ok && pqueue_reserve(&order, n) != NULL;
+    for (vertex_t v = 0; ok && v < n; v++) {
+        double p;
+        ok = priority(&C, v, &p) && pqueue_push(&order, v, p) != NULL;
+    }
+    size_t next_rank = 0;
+    while (ok && !pqueue_empty(&order)) {
+        vertex_t v;
+        pqueue_top(&order, &v, NULL);
+        double p;
+        double next;
+        ok = priority(&C, v, &p);
+        if (!ok) { break; }
+        if (pqueue_size(&order) > 1) {
+            pqueue_adjust_priority(&order, v, p);
+            pqueue_top(&order, NULL, &next);
+            if (p > next) { continue; }
+            pqueue_top(&order, &v, NULL);
+        }
+        pqueue_pop(&order);
+
+        size_t shortcuts;
+        ok = contract(&C, v, true, &shortcuts);
+        self->rank[v] = next_rank++;
+    }
+    pqueue_destroy(&order);
+
+    self->shortcut_count = C.shortcut_count;
+    ok = ok && pack(C.out, n, &self->up_offset, &self->up)
+        && pack(C.in, n, &self->down_offset, &self->down);
+    contraction_destroy(&C);
+
+    if (!ok) {
+        ch_destroy(self);
+        return NULL;
+    }
+    self->preprocessing_seconds = seconds_now() - started;
+    return self;
+}
+
+void ch_destroy(ch* self) {
+    free(self->rank);
+    free(self->up_offset);
+    free(self->up);
+    free(self->down_offset);
+    free(self->down);
+    free(self);
+}
+
+// Private helper returning the middle of the arc from a to b in a packed list
+// of arcs stored at at.
+static vertex_t middle_of(size_t* offset, ch_arc* arcs, vertex_t at, vertex_t other) {
+    for (size_t e = offset[at]; e < offset[at + 1]; e++) {
+        if (arcs[e].to == other) { return arcs[e].middle; }
+    }
+    return CH_NO_MIDDLE;
+}
+
+// The two sides of a query: side 0 searches upward from start, side 1
+// upward from end on the reversed arcs. hop[side][v] is the vertex v was
+// reached from and via[side][v] the middle of the arc used. Every vertex a
+// query reaches goes on the touched list of its side, through which the next
+// query resets it. The stacks that unpack the path come from a scratch
+// arena that every query resets, so once a workspace has unpacked a path as
+// long as the current one, unpacking allocates nothing.
+struct ch_search {
+    size_t n;
+    double* distance[2];
+    bool* settled[2];
+    vertex_t* hop[2];
+    vertex_t* via[2];
+    vertex_t* touched[2];
+    size_t touched_count[2];
+    pqueue queue[2];
+    arena* scratch;
+    ch_arc* stack;
+    vertex_t* from;
+    size_t stack_capacity;
+};
+
+// Private helper that moves the unpack stacks of a workspace to room for
+// capacity arcs in its scratch arena, keeping the size arcs on them.
+static bool unpack_reserve(ch_search* search, size_t size, size_t capacity) {
+    ch_arc* stack = arena_alloc(search->scratch, capacity * sizeof(ch_arc));
+    vertex_t* from = arena_alloc(search->scratch, capacity * sizeof(vertex_t));
+    if (stack == NULL || from == NULL) { return false; }
+    if (size > 0) {
+        memcpy(stack, search->stack, size * sizeof(ch_arc));
+        memcpy(from, search->from, size * sizeof(vertex_t));
+    }
+    search->stack = stack;
+    search->from = from;
+    search->stack_capacity = capacity;
+    return true;
+}
+
+// Private helper that unpacks the arc a->b through middle into original road
+// segments, writing the parent of every vertex after a. An explicit stack
+// holds the arcs still to expand, leftmost on top.
+static bool unpack(ch* self, ch_search* search, vertex_t a, vertex_t b, vertex_t middle, vertex_t* parent) {
+    if (search->stack_capacity == 0 && !unpack_reserve(search, 0, 64)) { return false; }
+    size_t size = 0;
+    ch_arc first = { b, 0.0, middle };
+    search->stack[size] = first;
+    search->from[size++] = a;
+
+    while (size > 0) {
+        size--;
+        vertex_t u = search->from[size];
+        ch_arc arc = search->stack[size];
+        if (arc.middle == CH_NO_MIDDLE) {
+            parent[arc.to] = u;
+            continue;
+        }
+        if (size + 2 > search->stack_capacity
+                && !unpack_reserve(search, size, 2 * search->stack_capacity)) { return false; }
+        // u->middle is a downward arc of middle, middle->to an upward one
+        vertex_t m = arc.middle;
+        ch_arc second = { arc.to, 0.0, middle_of(self->up_offset, self->up, m, arc.to) };
+        ch_arc first_half = { m, 0.0, middle_of(self->down_offset, self->down, m, u) };
+        search->stack[size] = second;
+        search->from[size++] = m;
+        search->stack[size] = first_half;
+        search->from[size++] = u;
+    }
+    return true;
+}
+
+ch_search* ch_search_create(size_t n) {
+    ch_search* self = calloc(1, sizeof(ch_search));
+    if (self == NULL) { return NULL; }
+    self->n = n;
+    self->scratch = arena_create();
+    bool ok = self->scratch != NULL;
+    for (size_t side = 0; side < 2; side++) {
+        pqueue_init(&self->queue[side]);
+        self->distance[side] = malloc((n + 1) * sizeof(double));
+        self->settled[side] = calloc(n + 1, sizeof(bool));
+        self->hop[side] = malloc((n + 1) * sizeof(vertex_t));
+        self->via[side] = malloc((n + 1) * sizeof(vertex_t));
+        self->touched[side] = malloc((n + 1) * sizeof(vertex_t));
+        ok = ok && self->distance[side] != NULL && self->settled[side] != NULL && self->hop[side] != NULL
+            && self->via[side] != NULL && self->touched[side] != NULL
+            && pqueue_reserve(&self->queue[side], n) != NULL;
+        for (size_t v = 0; ok && v < n; v++) self->distance[side][v] = INFINITY;
+    }
+    if (!ok) {
+        ch_search_destroy(self);
+        return NULL;
+    }
+    return self;
+}
+
+void ch_search_destroy(ch_search* self) {
+    for (size_t side = 0; side < 2; side++) {
+        free(self->distance[side]);
+        free(self->settled[side]);
+        free(self->hop[side]);
+        free(self->via[side]);
+        free(self->touched[side]);
+        pqueue_destroy(&self->queue[side]);
+    }
+    arena_destroy(self->scratch);
+    free(self);
+}
+
+ch* ch_search_query(ch_search* search, ch* self, vertex_t start, vertex_t end, vertex_t* parent, double* cost) {
+    size_t n = self->n;
+    if (start >= n || end >= n || search->n != n) { return NULL; }
+
+    double** distance = search->distance;
+    bool** settled = search->settled;
+    vertex_t** hop = search->hop;
+    vertex_t** via = search->via;
+    pqueue* queue = search->queue;
+    size_t* offset[2] = { self->up_offset, self->down_offset };
+    ch_arc* arcs[2] = { self->up, self->down };
+
+    arena_reset(search->scratch);
+    search->stack = NULL;
+    search->from = NULL;
+    search->stack_capacity = 0;
+
+    bool ok = true;
+    vertex_t origin[2] = { start, end };
+    for (size_t side = 0; side < 2; side++) {
+        for (size_t i = 0; i < search->touched_count[side]; i++) {
+            distance[side][search->touched[side][i]] = INFINITY;
+            settled[side][search->touched[side][i]] = false;
+        }
+        search->touched_count[side] = 0;
+        pqueue_clear(&queue[side]);
+        distance[side][origin[side]] = 0.0;
+        hop[side][origin[side]] = origin[side];
+        search->touched[side][search->touched_count[side]++] = origin[side];
+        ok = ok && pqueue_push(&queue[side], origin[side], 0.0) != NULL;
+    }
+
+    // A side stops once its closest vertex is no closer than the best meeting
+    double best = INFINITY;
+    vertex_t meet = start;
+    size_t side = 0;
+    while (ok) {
+        double key0 = INFINITY;
+        double key1 = INFINITY;
+        pqueue_top(&queue[0], NULL, &key0);
+        pqueue_top(&queue[1], NULL, &key1);
+        if (key0 >= best && key1 >= best) { break; }
+        side = key0 <= key1 ? 0 : 1;
+
+        vertex_t u;
+        double du;
+        pqueue_top(&queue[side], &u, &du);
+        pqueue_pop(&queue[side]);
+        settled[side][u] = true;
+        if (du + distance[1 - side][u] < best) {
+            best = du + distance[1 - side][u];
+            meet = u;
+        }
+
+        for (size_t e = offset[side][u]; ok && e < offset[side][u + 1]; e++) {
+            vertex_t x = arcs[side][e].to;
+            double d = du + arcs[side][e].weight;
+            if (settled[side][x] || d >= distance[side][x]) { continue; }
+            if (distance[side][x] == INFINITY) search->touched[side][search->touched_count[side]++] = x;
+            distance[side][x] = d;
+            hop[side][x] = u;
+            via[side][x] = arcs[side][e].middle;
+            ok = pqueue_contains(&queue[side], x)
+                ? pqueue_adjust_priority(&queue[side], x, d) != NULL
+                : pqueue_push(&queue[side], x, d) != NULL;
+        }
+    }
+
+    if (cost != NULL) *cost = best;
+    parent[start] = start;
+
+    // Unpack the hierarchy arcs from start up to meet, then from meet down to end
+    if (ok && best < INFINITY) {
+        for (vertex_t v = meet; ok && v != start; v = hop[0][v]) {
+            ok = unpack(self, search, hop[0][v], v, via[0][v], parent);
+        }
+        for (vertex_t v = meet; ok && v != end; v = hop[1][v]) {
+            ok = unpack(self, search, v, hop[1][v], via[1][v], parent);
+        }
+    }
+    return ok ? self : NULL;
+}
+
+ch* ch_query(ch* self, vertex_t start, vertex_t end, vertex_t* parent, double* cost) {
+    if (start >= self->n || end >= self->n) { return NULL; }
+    ch_search* search = ch_search_create(self->n);
+    if (search == NULL) { return NULL; }
+    ch* ok = ch_search_query(search, self, start, end, parent, cost);
+    ch_search_destroy(search);
+    return ok;
+}
+
+// Workspace of one upward search, reset through the touched list.
+typedef struct upward {
+    double* distance;
+    bool* stalled;
+    vertex_t* touched;
+    size_t touched_count;
+    pqueue queue;
+} upward;
+
+// An entry of a target's bucket: the target reaches the vertex holding the
+// entry with cost distance.
+typedef struct bucket_entry {
+    vertex_t vertex;
+    size_t target;
+    double distance;
+} bucket_entry;
+
+// Shared state of a distance table computation. Workers take sources, then
+// targets, by number from next.
+typedef struct table_job {
+    ch* H;
+    const vertex_t* sources;
+    size_t source_count;
+    const vertex_t* targets;
+    size_t target_count;
+    double* table;
+    bool backward;              // the phase: targets, or else sources
+    atomic_size_t next;
+    atomic_bool failed;
+    size_t* bucket_offset;      // n+1 entries
+    bucket_entry* buckets;      // by vertex
+} table_job;
+
+// Everything one worker of a distance table computation owns.
+typedef struct table_worker {
+    table_job* job;
+    upward search;
+    bucket_entry* entries;      // found in the backward phase
+    size_t entry_count;
+    size_t entry_capacity;
+} table_worker;
+
+// Private helper running an upward search from origin: a Dijkstra search
+// along the arcs of arcs that lead to higher ranked vertices, pruned by
+// stall-on-demand. A vertex u is stalled when an arc into it from a higher
+// vertex x, found in back, already gives a shorter way to u than the one it
+// was settled with; no shortest path to anything can then leave u upwards,
+// so it is neither expanded nor reported. The vertices reached are left in
+// W->touched, with their distance and whether they were stalled.
+static bool upward_search(upward* W, size_t* offset, ch_arc* arcs, size_t* back_offset,
+        ch_arc* back, vertex_t origin) {
+    for (size_t i = 0; i < W->touched_count; i++) {
+        W->distance[W->touched[i]] = INFINITY;
+        W->stalled[W->touched[i]] = false;
+    }
+    W->touched_count = 0;
+    pqueue_clear(&W->queue);
+
+    W->distance[origin] = 0.0;
+    W->touched[W->touched_count++] = origin;
+    if (pqueue_push(&W->queue, origin, 0.0) == NULL) { return false; }
+    while (!pqueue_empty(&W->queue)) {
+        vertex_t u;
+        double du;
+        pqueue_top(&W->queue, &u, &du);
+        pqueue_pop(&W->queue);
+
+        for (size_t e = back_offset[u]; !W->stalled[u] && e < back_offset[u + 1]; e++) {
+            W->stalled[u] = W->distance[back[e].to] + back[e].weight < du;
+        }
+        if (W->stalled[u]) { continue; }
+
+        for (size_t e = offset[u]; e < offset[u + 1]; e++) {
+            vertex_t x = arcs[e].to;
+            double d = du + arcs[e].weight;
+            if (d >= W->distance[x]) { continue; }
+            if (W->distance[x] == INFINITY) W->touched[W->touched_count++] = x;
+            W->distance[x] = d;
+            bool queued = pqueue_contains(&W->queue, x)
+                ? pqueue_adjust_priority(&W->queue, x, d) != NULL
+                : pqueue_push(&W->queue, x, d) != NULL;
+            if (!queued) { return false; }
+        }
+    }
+    return true;
+}
+
+// Private helper that answers the sources or targets a worker takes: a
+// backward search from a target adds an entry to the bucket of every vertex
+// it settles, and a forward search from a source looks up the buckets of
+// every vertex it settles to fill the source's row of the table.
+static void* table_work(void* arg) {
+    table_worker* T = arg;
+    table_job* J = T->job;
+    ch* H = J->H;
+    size_t count = J->backward ? J->target_count : J->source_count;
+    size_t i;
+    while (!atomic_load(&J->failed) && (i = atomic_fetch_add(&J->next, 1)) < count) {
+        bool ok = J->backward
+            ? upward_search(&T->search, H->down_offset, H->down, H->up_offset, H->up, J->targets[i])
+            : upward_search(&T->search, H->up_offset, H->up, H->down_offset, H->down, J->sources[i]);
+        double* row = J->table + i * J->target_count;
+        for (size_t t = 0; !J->backward && t < J->target_count; t++) row[t] = INFINITY;
+
+        for (size_t k = 0; ok && k < T->search.touched_count; k++) {
+            vertex_t u = T->search.touched[k];
+            double du = T->search.distance[u];
+            if (T->search.stalled[u]) { continue; }
+            if (!J->backward) {
+                for (size_t e = J->bucket_offset[u]; e < J->bucket_offset[u + 1]; e++) {
+                    double through = du + J->buckets[e].distance;
+                    if (through < row[J->buckets[e].target]) row[J->buckets[e].target] = through;
+                }
+                continue;
+            }
+            if (T->entry_count == T->entry_capacity) {
+                size_t cap = T->entry_capacity > 0 ? 2 * T->entry_capacity : 1024;
+                bucket_entry* grown = realloc(T->entries, cap * sizeof(bucket_entry));
+                ok = grown != NULL;
+                if (!ok) { break; }
+                T->entries = grown;
+                T->entry_capacity = cap;
+            }
+            bucket_entry entry = { u, i, du };
+            T->entries[T->entry_count++] = entry;
+        }
+        if (!ok) atomic_store(&J->failed, true);
+    }
+    return NULL;
+}
+
+// Private helper running one phase of a distance table on every worker, the
+// first on the calling thread. A worker that cannot be started leaves its
+// share to the others.
+static void table_phase(table_job* J, table_worker* workers, size_t threads, bool backward) {
+    J->backward = backward;
+    atomic_store(&J->next, 0);
+    pthread_t thread[CH_TABLE_MAX_THREADS];
+    bool started[CH_TABLE_MAX_THREADS];
+    for (size_t k = 1; k < threads; k++) {
+        started[k] = pthread_create(&thread[k], NULL, table_work, &workers[k]) == 0;
+    }
+    table_work(&workers[0]);
+    for (size_t k = 1; k < threads; k++) {
+        if (started[k]) pthread_join(thread[k], NULL);
+    }
+}
+
+ch* ch_table(ch* self, const vertex_t* sources, size_t source_count, const vertex_t* targets,
+        size_t target_count, double* table, size_t threads) {
+    size_t n = self->n;
+    for (size_t i = 0; i < source_count; i++) {
+        if (sources[i] >= n) { return NULL; }
+    }
+    for (size_t i = 0; i < target_count; i++) {
+        if (targets[i] >= n) { return NULL; }
+    }
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+    if (threads > CH_TABLE_MAX_THREADS) threads = CH_TABLE_MAX_THREADS;
+    size_t most = source_count > target_count ? source_count : target_count;
+    if (threads > most) threads = most > 0 ? most : 1;
+
+    table_job J = { self, sources, source_count, targets, target_count, table, true, 0, false, NULL, NULL };
+    table_worker* workers = calloc(threads, sizeof(table_worker));
+    bool ok = workers != NULL;
+    for (size_t k = 0; ok && k < threads; k++) {
+        table_worker* T = &workers[k];
+        T->job = &J;
+        pqueue_init(&T->search.queue);
+        T->search.distance = malloc((n + 1) * sizeof(double));
+        T->search.stalled = calloc(n + 1, sizeof(bool));
+        T->search.touched = malloc((n + 1) * sizeof(vertex_t));
+        ok = T->search.distance != NULL && T->search.stalled != NULL && T->search.touched != NULL
+            && pqueue_reserve(&T->search.queue, n) != NULL;
+        for (size_t v = 0; ok && v < n; v++) T->search.distance[v] = INFINITY;
+    }
+
+    // Buckets from the targets, then gathered by vertex with a counting sort
+    if (ok) {
+        table_phase(&J, workers, threads, true);
+        ok = !atomic_load(&J.failed);
+    }
+    size_t entry_count = 0;
+    for (size_t k = 0; ok && k < threads; k++) entry_count += workers[k].entry_count;
+    J.bucket_offset = ok ? calloc(n + 2, sizeof(size_t)) : NULL;
+    J.buckets = ok ? malloc((entry_count + 1) * sizeof(bucket_entry)) : NULL;
+    ok = ok && J.bucket_offset != NULL && J.buckets != NULL;
+    for (size_t k = 0; ok && k < threads; k++) {
+        for (size_t e = 0; e < workers[k].entry_count; e++) J.bucket_offset[workers[k].entries[e].vertex + 2]++;
+    }
+    for (size_t v = 0; ok && v < n; v++) J.bucket_offset[v + 2] += J.bucket_offset[v + 1];
+    for (size_t k = 0; ok && k < threads; k++) {
+        for (size_t e = 0; e < workers[k].entry_count; e++) {
+            J.buckets[J.bucket_offset[workers[k].entries[e].vertex + 1]++] = workers[k].entries[e];
+        }
+        free(workers[k].entries);
+        workers[k].entries = NULL;
+    }
+
+    // Then the rows, one source at a time
+    if (ok) {
+        table_phase(&J, workers, threads, false);
+        ok = !atomic_load(&J.failed);
+    }
+
+    for (size_t k = 0; workers != NULL && k < threads; k++) {
+        free(workers[k].search.distance);
+        free(workers[k].search.stalled);
+        free(workers[k].search.touched);
+        free(workers[k].entries);
+        pqueue_destroy(&workers[k].search.queue);
+    }
+    free(workers);
+    free(J.bucket_offset);
+    free(J.buckets);
+    return ok ? self : NULL;
+}
+
+size_t ch_memory(ch* self) {
+    return sizeof(ch) + (self->n + 1) * 3 * sizeof(size_t)
+        + (self->up_offset[self->n] + self->down_offset[self->n]) * sizeof(ch_arc);
+}
@@ -0,0 +1,180 @@
+/**
+ * This header provides contraction hierarchies (CH) for fast repeated
+ * shortest path queries on a map that rarely changes.
+ *
+ * Preprocessing contracts the vertices one at a time, least important first.
+ * Contracting v removes it from the remaining graph and adds a shortcut u->w
+ * for every path u->v->w that is the only shortest way from u to w among the
+ * remaining vertices. The rank of a vertex is its position in that order.
+ *
+ * A query then runs a forward search from the start and a backward search
+ * from the end, both only along edges that lead to higher ranked vertices,
+ * which together touch a tiny part of the map. Every shortcut remembers the
+ * vertex it skips, so the path found is unpacked back into the original road
+ * segments.
+ */
+#ifndef __CH_H__
+#define __CH_H__
+
+#include "graph.h"
+
+// Middle vertex recorded for edges that are original road segments.
+#define CH_NO_MIDDLE ((vertex_t)-1)
+
+// Settled vertices after which a witness search gives up and keeps the
+// shortcut. Extra shortcuts cost memory but never correctness.
+#ifndef CH_WITNESS_LIMIT
+#define CH_WITNESS_LIMIT 500
+#endif
+
+// Most threads ch_table runs on.
+#define CH_TABLE_MAX_THREADS 64
+
+/*
+ * An edge of the hierarchy: an original road when middle is CH_NO_MIDDLE,
+ * and otherwise a shortcut through middle.
+ */
+typedef struct ch_arc
+{
+    vertex_t to;
+    double weight;
+    vertex_t middle;
+} ch_arc;
+
+/**
+ * Struct holding a contraction hierarchy of one map and metric.
+ */
+typedef struct ch
+{
+    size_t n;
+    char metric;                  // 'D' or 'T'
+    size_t* rank;                 // contraction order of every vertex
+    size_t* up_offset;            // n+1 entries
+    ch_arc* up;                   // u->x with rank[x] > rank[u], by u
+    size_t* down_offset;          // n+1 entries
+    ch_arc* down;                 // x->u with rank[x] > rank[u], by u (to = x)
+    size_t edge_count;            // original edges kept in the hierarchy
+    size_t shortcut_count;        // shortcuts added by contraction
+    double preprocessing_seconds;
+} ch;
+
+/**
+ * Builds the contraction hierarchy of a map.
+ *
+ * Vertices are contracted in order of edge difference (shortcuts added minus
+ * edges removed) plus the number of already contracted neighbors, with lazy
+ * updates. Witness searches are bounded by CH_WITNESS_LIMIT.
+ *
+ * @param  G      the map
+ * @param  metric 'D' for distance or 'T' for time
+ * @return        the hierarchy, or NULL if memory allocation failed
+ */
+ch* ch_create(graph* G, char metric);
+
+/**
+ * Frees all memory associated with a contraction hierarchy.
+ *
+ * @param self the hierarchy being deallocated
+ */
+void ch_destroy(ch* self);
+
+/**
+ * Finds a shortest path from start to end.
+ *
+ * The path is unpacked into original road segments and written as parents,
+ * so the output feeds graph_traverse_parents like that of graph_dijkstras_to.
+ * Only the entries on the path are written. Each call sets up a workspace of
+ * O(n); repeated queries should use ch_search_query.
+ *
+ * @param  self        the hierarchy of the map being searched
+ * @param  start       the starting vertex
+ * @param  end         the vertex the search is for
+ * @param  parent[out] the output array of parents
+ * @param  cost[out]   the length of the path in the hierarchy's metric, or
+ *                     INFINITY if end cannot be reached; may be NULL
+ * @return             self, or NULL if start or end are not vertices of the
+ *                     map or memory for the search could not be allocated
+ */
+ch* ch_query(ch* self, vertex_t start, vertex_t end, vertex_t* parent, double* cost);
+
+/**
+ * Forward declared workspace of CH queries, hiding implementation details.
+ * It keeps its arrays between queries and resets only the entries the last
+ * query reached, so a query costs time in proportion to its search space.
+ * A workspace belongs to one thread at a time, and serves any hierarchy of
+ * a map with its number of vertices.
+ */
+typedef struct ch_search ch_search;
+
+/**
+ * Creates a workspace for CH queries.
+ *
+ * Runtime: O(n), once
+ *
+ * @param  n the number of vertices of the map
+ * @return   the workspace, or NULL if memory allocation failed
+ */
+ch_search* ch_search_create(size_t n);
+
+/**
+ * Frees all memory associated with a workspace.
+ *
+ * @param self the workspace being deallocated
+ */
+void ch_search_destroy(ch_search* self);
+
+/**
+ * ch_query in a workspace.
+ *
+ * Runtime: O(search space of start and end + path length)
+ *
+ * @param  search      the workspace
+ * @param  self        the hierarchy of the map being searched
+ * @param  start       the starting vertex
+ * @param  end         the vertex the search is for
+ * @param  parent[out] the output array of parents
+ * @param  cost[out]   as for ch_query; may be NULL
+ * @return             self, or NULL as for ch_query
+ */
+ch* ch_search_query(ch_search* search, ch* self, vertex_t start, vertex_t end, vertex_t* parent, double* cost);
+
+/**
+ * Computes the cost of a shortest path from every source to every target,
+ * for an origin x destination matrix.
+ *
+ * Uses bucket based many-to-many search. An upward search from every target
+ * on the reversed arcs leaves an entry (target, cost) in the bucket of each
+ * vertex it settles; an upward search from every source then meets them in
+ * the buckets of the vertices it settles, and the best meeting is the
+ * shortest path. Both searches are pruned by stall-on-demand. Each phase is
+ * spread over threads, the sources and targets taken one at a time.
+ *
+ * Runtime: O((s + t) * search space + bucket entries met), with the search
+ * space of a hierarchy typically a few hundred vertices
+ * Memory: O(threads * n + t * search space)
+ *
+ * @param  self         the hierarchy of the map; its metric is the table's
+ * @param  sources      the origins
+ * @param  source_count the number of origins, s
+ * @param  targets      the destinations
+ * @param  target_count the number of destinations, t
+ * @param  table[out]   s * t entries; table[i * t + j] receives the cost from
+ *                      sources[i] to targets[j], or INFINITY if there is no
+ *                      path
+ * @param  threads      the threads to use, 0 for one per online core; at most
+ *                      CH_TABLE_MAX_THREADS are used
+ * @return              self, or NULL if a source or target is not a vertex of
+ *                      the map or memory allocation failed
+ */
+ch* ch_table(ch* self, const vertex_t* sources, size_t source_count, const vertex_t* targets,
+        size_t target_count, double* table, size_t threads);
+
+/**
+ * Returns the number of bytes used by a contraction hierarchy.
+ *
+ * @param  self the hierarchy
+ * @return      the memory footprint in bytes
+ */
+size_t ch_memory(ch* self);
+
+#endif//__CH_H__
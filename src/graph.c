@@ -1,40 +1,174 @@
 // Implementations of the function declarations in graph.h.
 #include "graph.h"
 #include <assert.h>
+#include <string.h>
 
+// The graph is stored in compressed sparse row (CSR) form. The outgoing edges
+// of u occupy the index range [offset[u], offset[u+1]) of the flat target,
+// distance and speed arrays, so memory is O(n + m) and a row is contiguous.
 struct graph {
     size_t n;
     size_t m;
     bool directed;
-    vertex_t** adj_list;
-    size_t* degree;
+    size_t* offset;    // n+1 entries
+    vertex_t* target;  // m entries
+    double* distance;  // m entries, per-edge road length
+    double* speed;     // m entries, per-edge road speed
+    size_t capacity;   // allocated length of the edge arrays
+    bool owned;        // false when the arrays belong to someone else
+    size_t version;    // bumped whenever an edge is added or removed
 };
 
-graph* graph_create(size_t n, bool directed) {
+// Private helper that makes room for at least cap edges.
+static bool graph_reserve(graph* self, size_t cap) {
+    if (cap <= self->capacity) { return true; }
+
+    size_t new_cap = self->capacity > 0 ? self->capacity : 4;
+    while (new_cap < cap) new_cap *= 2;
+
+    vertex_t* target = realloc(self->target, new_cap * sizeof(vertex_t));
+    if (target == NULL) { return false; }
+    self->target = target;
+    double* distance = realloc(self->distance, new_cap * sizeof(double));
+    if (distance == NULL) { return false; }
+    self->distance = distance;
+    double* speed = realloc(self->speed, new_cap * sizeof(double));
+    if (speed == NULL) { return false; }
+    self->speed = speed;
+
+    self->capacity = new_cap;
+    return true;
+}
+
+// Private helper that allocates a graph with n vertices and room for cap edges.
+static graph* graph_alloc(size_t n, size_t cap, bool directed) {
     graph* new_graph = malloc(sizeof(graph));
+    if (new_graph == NULL) { return NULL; }
 
     new_graph->n = n;
     new_graph->m = 0;
     new_graph->directed = directed;
+    new_graph->offset = calloc(n + 1, sizeof(size_t));
+    new_graph->target = NULL;
+    new_graph->distance = NULL;
+    new_graph->speed = NULL;
+    new_graph->capacity = 0;
+    new_graph->owned = true;
+    new_graph->version = 0;
 
-    new_graph->adj_list = malloc(n * sizeof(vertex_t*));
-    for (size_t i = 0; i < n; i++) {
-        new_graph->adj_list[i] = malloc(n * sizeof(vertex_t));
+    if (new_graph->offset == NULL || !graph_reserve(new_graph, cap)) {
+        graph_destroy(new_graph);
+        return NULL;
     }
+    return new_graph;
+}
 
-    new_graph->degree = malloc(n * sizeof(size_t));
-    for (size_t i = 0; i < n; i++) new_graph->degree[i] = 0;
+graph* graph_create(size_t n, bool directed) {
+    return graph_alloc(n, 0, directed);
+}
+
+graph* graph_create_from_roads(size_t n, road_record* roads, size_t road_count, bool directed) {
+    size_t arcs = directed ? road_count : 2 * road_count;
+    graph* new_graph = graph_alloc(n, arcs, directed);
+    if (new_graph == NULL) { return NULL; }
+
+    // Count the out degree of every vertex, then prefix sum into row offsets.
+    size_t* offset = new_graph->offset;
+    for (size_t i = 0; i < road_count; i++) {
+        assert(roads[i].start < n && roads[i].end < n);
+        offset[roads[i].start + 1]++;
+        if (!directed) offset[roads[i].end + 1]++;
+    }
+    for (size_t u = 0; u < n; u++) offset[u + 1] += offset[u];
+
+    // Scatter the roads into their rows, keeping the input order within a row.
+    size_t* next = malloc((n + 1) * sizeof(size_t));
+    if (next == NULL) {
+        graph_destroy(new_graph);
+        return NULL;
+    }
+    memcpy(next, offset, (n + 1) * sizeof(size_t));
+    for (size_t i = 0; i < road_count; i++) {
+        size_t e = next[roads[i].start]++;
+        new_graph->target[e] = roads[i].end;
+        new_graph->distance[e] = roads[i].distance;
+        new_graph->speed[e] = roads[i].speed;
+        if (!directed) {
+            e = next[roads[i].end]++;
+            new_graph->target[e] = roads[i].start;
+            new_graph->distance[e] = roads[i].distance;
+            new_graph->speed[e] = roads[i].speed;
+        }
+    }
+
+    // Drop repeated u->v roads in place. As with graph_add_edge an edge is
+    // only stored once; the last road listed for a pair supplies its weights.
+    // A first pass records where each target of the row last appears, so the
+    // second keeps an edge only at that position and the rows stay O(deg).
+    size_t* last = next;
+    size_t m = 0;
+    size_t row_start = 0;
+    for (size_t u = 0; u < n; u++) {
+        size_t row_end = offset[u + 1];
+        offset[u] = m;
+        for (size_t e = row_start; e < row_end; e++) {
+            last[new_graph->target[e]] = e;
+        }
+        for (size_t e = row_start; e < row_end; e++) {
+            if (last[new_graph->target[e]] == e) {
+                new_graph->target[m] = new_graph->target[e];
+                new_graph->distance[m] = new_graph->distance[e];
+                new_graph->speed[m] = new_graph->speed[e];
+                m++;
+            }
+        }
+        row_start = row_end;
+    }
+    free(next);
+
+    offset[n] = m;
+    new_graph->m = m;
 
     return new_graph;
 }
 
+graph* graph_create_view(size_t n, size_t m, bool directed, const size_t* offset,
+        const vertex_t* target, const double* distance, const double* speed) {
+    if (offset[n] != m) { return NULL; }
+    graph* new_graph = malloc(sizeof(graph));
+    if (new_graph == NULL) { return NULL; }
+
+    new_graph->n = n;
+    new_graph->m = m;
+    new_graph->directed = directed;
+    new_graph->offset = (size_t*)offset;
+    new_graph->target = (vertex_t*)target;
+    new_graph->distance = (double*)distance;
+    new_graph->speed = (double*)speed;
+    new_graph->capacity = m;
+    new_graph->owned = false;
+    new_graph->version = 0;
+    return new_graph;
+}
+
 void graph_destroy(graph* self) {
-    free(self->degree);
-    for (size_t i = 0; i < self->n; i++) free(self->adj_list[i]);
-    free(self->adj_list);
+    if (self->owned) {
+        free(self->offset);
+        free(self->target);
+        free(self->distance);
+        free(self->speed);
+    }
     free(self);
 }
 
+void graph_storage(graph* self, const size_t** offset, const vertex_t** target,
+        const double** distance, const double** speed) {
+    *offset = self->offset;
+    *target = self->target;
+    *distance = self->distance;
+    *speed = self->speed;
+}
+
 size_t graph_vertex_count(graph* self) {
     return self->n;
 }
@@ -47,22 +181,25 @@ size_t graph_edge_count(graph* self) {
     }
 }
 
+size_t graph_version(graph* self) {
+    return self->version;
+}
+
 bool graph_directed(graph* self) {
     return self->directed;
 }
 
 // Private helper function for location a neighboring vertex
-// in the adjacency list of another vertex.
-int graph_edge_search(graph* self, vertex_t u, vertex_t v) {
+// in the adjacency list of another vertex. Returns the edge index or -1.
+static long graph_edge_search(graph* self, vertex_t u, vertex_t v) {
     assert(u < self->n && v < self->n);
 
-    int loc = -1;
-    for (size_t i = 0; i < self->degree[u]; i++) {
-        if (self->adj_list[u][i] == v) {
-          loc = i;
+    for (size_t e = self->offset[u]; e < self->offset[u + 1]; e++) {
+        if (self->target[e] == v) {
+            return (long)e;
         }
     }
-    return loc;
+    return -1;
 }
 
 graph* graph_edge(graph* self, vertex_t u, vertex_t v, bool* has_edge) {
@@ -76,10 +213,34 @@ graph* graph_edge(graph* self, vertex_t u, vertex_t v, bool* has_edge) {
     return self;
 }
 
+graph* graph_edge_weights(graph* self, vertex_t u, vertex_t v, double* distance, double* speed) {
+    if (u >= self->n || v >= self->n) { return NULL; }
+
+    long e = graph_edge_search(self, u, v);
+    if (e < 0) { return NULL; }
+    if (distance != NULL) *distance = self->distance[e];
+    if (speed != NULL) *speed = self->speed[e];
+
+    return self;
+}
+
 graph* graph_degree(graph* self, vertex_t u, size_t* deg) {
     if (u >= self->n) { return NULL; }
 
-    *deg = self->degree[u];
+    *deg = self->offset[u + 1] - self->offset[u];
+
+    return self;
+}
+
+graph* graph_out_edges(graph* self, vertex_t u, const vertex_t** targets, const double** distances,
+        const double** speeds, size_t* deg) {
+    if (u >= self->n) { return NULL; }
+
+    size_t first = self->offset[u];
+    if (targets != NULL) *targets = self->target + first;
+    if (distances != NULL) *distances = self->distance + first;
+    if (speeds != NULL) *speeds = self->speed + first;
+    if (deg != NULL) *deg = self->offset[u + 1] - first;
 
     return self;
 }
@@ -87,24 +248,64 @@ graph* graph_degree(graph* self, vertex_t u, size_t* deg) {
 graph* graph_neighbors(graph* self, vertex_t u, vertex_t* vs) {
     if (u >= self->n) { return NULL; }
 
-    for (size_t i = 0; i < self->degree[u]; i++) vs[i] = self->adj_list[u][i];
+    size_t first = self->offset[u];
+    size_t deg = self->offset[u + 1] - first;
+    memcpy(vs, self->target + first, deg * sizeof(vertex_t));
 
     return self;
 }
 
+graph* graph_neighbor_weights(graph* self, vertex_t u, double* distances, double* speeds) {
+    if (u >= self->n) { return NULL; }
+
+    size_t first = self->offset[u];
+    size_t deg = self->offset[u + 1] - first;
+    if (distances != NULL) memcpy(distances, self->distance + first, deg * sizeof(double));
+    if (speeds != NULL) memcpy(speeds, self->speed + first, deg * sizeof(double));
+
+    return self;
+}
+
+// Private helper that inserts the edge u->v at the end of row u.
+static bool graph_insert_edge(graph* self, vertex_t u, vertex_t v) {
+    if (!graph_reserve(self, self->m + 1)) { return false; }
+
+    size_t e = self->offset[u + 1];
+    size_t tail = self->m - e;
+    memmove(self->target + e + 1, self->target + e, tail * sizeof(vertex_t));
+    memmove(self->distance + e + 1, self->distance + e, tail * sizeof(double));
+    memmove(self->speed + e + 1, self->speed + e, tail * sizeof(double));
+    self->target[e] = v;
+    self->distance[e] = 0.0;
+    self->speed[e] = 0.0;
+
+    for (size_t w = u + 1; w <= self->n; w++) self->offset[w]++;
+    self->m++;
+    self->version++;
+    return true;
+}
+
+// Private helper that deletes the edge stored at index e of row u.
+static void graph_delete_edge(graph* self, vertex_t u, size_t e) {
+    size_t tail = self->m - e - 1;
+    memmove(self->target + e, self->target + e + 1, tail * sizeof(vertex_t));
+    memmove(self->distance + e, self->distance + e + 1, tail * sizeof(double));
+    memmove(self->speed + e, self->speed + e + 1, tail * sizeof(double));
+
+    for (size_t w = u + 1; w <= self->n; w++) self->offset[w]--;
+    self->m--;
+    self->version++;
+}
+
 graph* graph_add_edge(graph* self, vertex_t u, vertex_t v) {
-    if (u >= self->n || v >= self->n) { return NULL; }
+    if (u >= self->n || v >= self->n || !self->owned) { return NULL; }
 
     bool has_edge = false;
     graph_edge(self, u, v, &has_edge);
     if (!has_edge) { // Do nothing if edge already exists
-        self->adj_list[u][self->degree[u]] = v;
-        self->degree[u]++;
-        self->m++;
+        if (!graph_insert_edge(self, u, v)) { return NULL; }
         if (!self->directed) { // Add reverse edge if graph is undirected
-            self->adj_list[v][self->degree[v]] = u;
-            self->degree[v]++;
-            self->m++;
+            if (!graph_insert_edge(self, v, u)) { return NULL; }
         }
     }
 
@@ -112,19 +313,15 @@ graph* graph_add_edge(graph* self, vertex_t u, vertex_t v) {
 }
 
 graph* graph_remove_edge(graph* self, vertex_t u, vertex_t v) {
-    if (u >= self->n || v >= self->n) { return NULL; }
+    if (u >= self->n || v >= self->n || !self->owned) { return NULL; }
 
-    int loc = graph_edge_search(self, u, v);
+    long loc = graph_edge_search(self, u, v);
     if (loc >= 0) {
-        self->adj_list[u][loc] = self->adj_list[u][self->degree[u] - 1];
-        self->degree[u]--;
-        self->m--;
+        graph_delete_edge(self, u, (size_t)loc);
         if (!self->directed) {
             loc = graph_edge_search(self, v, u);
             assert(loc >= 0);
-            self->adj_list[v][loc] = self->adj_list[v][self->degree[v] - 1];
-            self->degree[v]--;
-            self->m--;
+            graph_delete_edge(self, v, (size_t)loc);
         }
     }
 
@@ -140,9 +337,9 @@ void graph_write(graph* self, FILE* stream)
 
     for (size_t i = 0; i < self->n; i++) {
         fprintf(stream, "%zu : ", i);
-        for (size_t j = 0; j < self->degree[i]; j++) {
-            fprintf(stream, "%zu ", self->adj_list[i][j]);
+        for (size_t e = self->offset[i]; e < self->offset[i + 1]; e++) {
+            fprintf(stream, "%zu ", self->target[e]);
         }
-        fprintf(stream, "[%zu]\n", self->degree[i]);
+        fprintf(stream, "[%zu]\n", self->offset[i + 1] - self->offset[i]);
     }
 }
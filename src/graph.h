@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "parser.h"
 
 // Typedef to make function signatures clearer.
 typedef unsigned long vertex_t;
@@ -25,6 +26,47 @@ typedef struct graph graph;
  */
 graph* graph_create(size_t n, bool directed);
 
+/**
+ * Creates a new graph with V = {0,1,2,...,n-1} whose edges are the given
+ * road segments. Each edge carries the distance and speed of its road.
+ *
+ * The graph is built in a single counting pass over the roads, so this is the
+ * preferred way to load a map. If a start/end pair is listed more than once,
+ * the edge is stored once with the weights of the last listing.
+ *
+ * Runtime: O(n + m)
+ *
+ * @param  n          the number of vertices
+ * @param  roads      the road segments; start and end must be less than n
+ * @param  road_count the number of road segments
+ * @param  directed   false to also add the reverse of every road
+ * @return            a new graph or NULL if memory allocation failed
+ */
+graph* graph_create_from_roads(size_t n, road_record* roads, size_t road_count, bool directed);
+
+/**
+ * Creates a read-only graph over CSR arrays owned by the caller, such as a
+ * memory mapped map file. Nothing is copied: the out edges of u are
+ * target[offset[u]..offset[u+1]) with the matching distance and speed.
+ *
+ * The arrays must outlive the graph. graph_add_edge and graph_remove_edge
+ * fail on such a graph, and graph_destroy leaves the arrays alone.
+ *
+ * Runtime: O(1)
+ *
+ * @param  n        the number of vertices
+ * @param  m        the number of stored edges; must equal offset[n]
+ * @param  directed false if every edge is stored in both directions
+ * @param  offset   n+1 row offsets
+ * @param  target   m edge targets, each less than n
+ * @param  distance m edge lengths
+ * @param  speed    m edge speeds
+ * @return          a new graph, or NULL if offset[n] != m or memory
+ *                  allocation failed
+ */
+graph* graph_create_view(size_t n, size_t m, bool directed, const size_t* offset,
+        const vertex_t* target, const double* distance, const double* speed);
+
 /**
  * Deallocates all memory associated with a graph.
  *
@@ -32,6 +74,21 @@ graph* graph_create(size_t n, bool directed);
  */
 void graph_destroy(graph* self);
 
+/**
+ * Exposes the CSR arrays of a graph, laid out as for graph_create_view.
+ * The arrays remain valid until the graph is modified or destroyed.
+ *
+ * Runtime: O(1)
+ *
+ * @param  self          the graph being queried
+ * @param  offset[out]   assigned the n+1 row offsets
+ * @param  target[out]   assigned the edge targets
+ * @param  distance[out] assigned the edge lengths
+ * @param  speed[out]    assigned the edge speeds
+ */
+void graph_storage(graph* self, const size_t** offset, const vertex_t** target,
+        const double** distance, const double** speed);
+
 /**
  * Returns the number of vertices in a graph.
  *
@@ -62,6 +119,18 @@ size_t graph_edge_count(graph* self);
  */
 bool graph_directed(graph* self);
 
+/**
+ * Returns the version of a graph, which changes whenever an edge is added or
+ * removed. Whatever was computed from the graph at one version may be stale
+ * at any other.
+ *
+ * Runtime: O(1)
+ *
+ * @param  self the graph being queried
+ * @return      its version, 0 for a graph that was never modified
+ */
+size_t graph_version(graph* self);
+
 /**
  * Determines if there is an edge between two vertices.
  *
@@ -76,6 +145,23 @@ bool graph_directed(graph* self);
  */
 graph* graph_edge(graph* self, vertex_t u, vertex_t v, bool* has_edge);
 
+/**
+ * Looks up the weights stored on the edge u->v.
+ *
+ * Runtime: O(deg(u))
+ *
+ * Note: output parameters may be NULL if the caller does not need this output.
+ *
+ * @param  self the graph being queried
+ * @param  u    source vertex
+ * @param  v    destination vertex
+ * @param  distance[out] assigned the length of the edge
+ * @param  speed[out]    assigned the speed of the edge
+ * @pre         u and v are valid vertices for self and u->v is an edge
+ * @return      self if preconditions are met and NULL otherwise
+ */
+graph* graph_edge_weights(graph* self, vertex_t u, vertex_t v, double* distance, double* speed);
+
 /**
  * Determines the (out) degree of a vertex.
  *
@@ -89,10 +175,33 @@ graph* graph_edge(graph* self, vertex_t u, vertex_t v, bool* has_edge);
  */
 graph* graph_degree(graph* self, vertex_t u, size_t* deg);
 
+/**
+ * Gives the (outgoing) edges of a vertex without copying them: deg
+ * consecutive entries of the graph's own target, distance and speed arrays.
+ * This is the way to walk the edges of a vertex; graph_neighbors and
+ * graph_neighbor_weights copy the same entries out.
+ *
+ * Runtime: O(1)
+ *
+ * Note: output parameters may be NULL if the caller does not need this output.
+ * The spans remain valid until the graph is modified or destroyed.
+ *
+ * @param  self the graph being queried
+ * @param  u    a source vertex
+ * @param  targets[out]   assigned the neighbors of u
+ * @param  distances[out] assigned the lengths of its edges
+ * @param  speeds[out]    assigned the speeds of its edges
+ * @param  deg[out]       assigned the degree of u
+ * @pre         u is a valid vertex for self
+ * @return      self if preconditions are met and NULL otherwise
+ */
+graph* graph_out_edges(graph* self, vertex_t u, const vertex_t** targets, const double** distances,
+        const double** speeds, size_t* deg);
+
 /**
  * Determines the (outgoing) neighbors of a vertex.
  *
- * Runtime: O(n)
+ * Runtime: O(deg(u))
  *
  * Warning: The array vs must be of size at least deg(u).
  *
@@ -105,11 +214,29 @@ graph* graph_degree(graph* self, vertex_t u, size_t* deg);
 graph* graph_neighbors(graph* self, vertex_t u, vertex_t* vs);
 
 /**
- * Adds an edge to a graph.
+ * Determines the weights of the (outgoing) edges of a vertex, in the same
+ * order as the neighbors returned by graph_neighbors.
+ *
+ * Runtime: O(deg(u))
+ *
+ * Warning: Each non-NULL array must be of size at least deg(u).
+ *
+ * @param  self the graph being queried
+ * @param  u    a source vertex
+ * @param  distances[out] assigned the edge lengths, or NULL
+ * @param  speeds[out]    assigned the edge speeds, or NULL
+ * @pre         u is a valid vertex for self
+ * @return      self if preconditions are met and NULL otherwise
+ */
+graph* graph_neighbor_weights(graph* self, vertex_t u, double* distances, double* speeds);
+
+/**
+ * Adds an edge to a graph. The new edge has zero distance and speed.
  *
- * Runtime: O(n)
+ * Runtime: O(n + m), since the edge arrays after row u are shifted
  *
  * Note: If the edge being added is already in the graph, no action is performed.
+ * Use graph_create_from_roads to build a whole map. Views are read-only.
  *
  * @param  self the graph being modified
  * @param  u    the source vertex
@@ -122,7 +249,7 @@ graph* graph_add_edge(graph* self, vertex_t u, vertex_t v);
 /**
  * Removes an edge from a graph.
  *
- * Runtime: O(n)
+ * Runtime: O(n + m)
  *
  * Note: If the edge being removed is not in the graph, no action is performed.
  *
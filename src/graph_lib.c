@@ -1,22 +1,109 @@
 #include "graph_lib.h"
 #include "pqueue.h"
+#include "rheap.h"
 #include "queue.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// Priority queue used by the shortest path searches, see graph_set_queue.
+static graph_queue search_queue = GRAPH_QUEUE_HEAP;
+
+void graph_set_queue(graph_queue kind) {
+    search_queue = kind;
+}
+
+// The frontier of a shortest path search, held in whichever priority queue
+// was selected. The indexed heap updates a queued vertex in place; the radix
+// heap queues it again, and the stale copies are skipped when popped.
+typedef struct frontier {
+    graph_queue kind;
+    pqueue heap;
+    rheap radix;
+} frontier;
+
+// Private helper that sets up an empty frontier for the vertices 0 ... n-1.
+static bool frontier_init(frontier* F, size_t n) {
+    F->kind = search_queue;
+    pqueue_init(&F->heap);
+    rheap_init(&F->radix);
+    return F->kind == GRAPH_QUEUE_RADIX || pqueue_reserve(&F->heap, n) != NULL;
+}
+
+static void frontier_destroy(frontier* F) {
+    pqueue_destroy(&F->heap);
+    rheap_destroy(&F->radix);
+}
+
+// Private helper that queues v with priority d, or lowers its priority.
+static bool frontier_push(frontier* F, vertex_t v, double d) {
+    if (F->kind == GRAPH_QUEUE_RADIX) {
+        return rheap_push(&F->radix, v, d) != NULL;
+    }
+    if (pqueue_contains(&F->heap, v)) {
+        return pqueue_adjust_priority(&F->heap, v, d) != NULL;
+    }
+    return pqueue_push(&F->heap, v, d) != NULL;
+}
+
+// Private helper that finds the closest vertex that is not yet settled,
+// discarding stale radix heap entries on the way. Returns false once the
+// frontier is exhausted.
+static bool frontier_peek(frontier* F, const bool* settled, vertex_t* v, double* d) {
+    if (F->kind == GRAPH_QUEUE_RADIX) {
+        while (rheap_top(&F->radix, v, d) != NULL) {
+            if (!settled[*v]) { return true; }
+            rheap_pop(&F->radix);
+        }
+        return false;
+    }
+    return pqueue_top(&F->heap, v, d) != NULL;
+}
+
+// Private helper that removes the closest vertex that is not yet settled.
+// Returns false once the frontier is exhausted.
+static bool frontier_pop(frontier* F, const bool* settled, vertex_t* v) {
+    if (!frontier_peek(F, settled, v, NULL)) { return false; }
+    if (F->kind == GRAPH_QUEUE_RADIX) {
+        rheap_pop(&F->radix);
+    } else {
+        pqueue_pop(&F->heap);
+    }
+    return true;
+}
 
 graph* graph_edge_reversal(graph* G) {
     size_t vertexCount = graph_vertex_count(G);
-    graph* newG = graph_create(vertexCount, graph_directed(G));
+    bool directed = graph_directed(G);
 
-    vertex_t neighbors[vertexCount];
-    size_t deg = 0;
+    // Collect every edge backwards, with its weights, and build the new graph
+    // in one pass. An undirected graph lists each edge once.
+    road_record* reversed = malloc((graph_edge_count(G) + 1) * sizeof(road_record));
+    if (reversed == NULL) { return NULL; }
+    size_t count = 0;
 
     for (vertex_t i = 0; i < vertexCount; i++){
-        deg = 0;
-        if (graph_degree(G, i, &deg) != NULL && graph_neighbors(G, i, neighbors) != NULL){
-            for (vertex_t j = 0; j < deg; j++){
-                graph_add_edge(newG, neighbors[j], i);
+        const vertex_t* target;
+        const double* distances;
+        const double* speeds;
+        size_t deg;
+        graph_out_edges(G, i, &target, &distances, &speeds, &deg);
+        for (size_t e = 0; e < deg; e++){
+            if (directed || i <= target[e]) {
+                reversed[count].start = target[e];
+                reversed[count].end = i;
+                reversed[count].distance = distances[e];
+                reversed[count].speed = speeds[e];
+                count++;
             }
         }
     }
+
+    graph* newG = graph_create_from_roads(vertexCount, reversed, count, directed);
+    free(reversed);
     return newG;
 }
 
@@ -25,14 +112,15 @@ void graph_bfs(graph* G, vertex_t start, vertex_t* parent) {
 
     size_t n = graph_vertex_count(G);
 
-    bool marked[n];
+    // A vertex other than start is marked once its parent is not itself
     for (i = 0; i < n; ++i) {
         parent[i] = i;
-        marked[i] = false;
     }
 
-    marked[start] = true;
+    // Every vertex enters the queue at most once, so once reserved for n it
+    // never allocates again
     queue* Q = queue_create();
+    queue_reserve(Q, n);
     queue_add_last(Q, start);
 
     while (!queue_empty(Q)) {
@@ -41,142 +129,914 @@ void graph_bfs(graph* G, vertex_t start, vertex_t* parent) {
         queue_get_first(Q, &current);
         queue_remove_first(Q);
 
-        // vertex_t neighbors[n] = neighbors of current
-        size_t current_deg;
-        graph_degree(G, current, &current_deg);
-        vertex_t neighbors[n];
-        graph_neighbors(G, current, neighbors);
-
-        for (i = 0; i < current_deg; ++i) {
-            if (!marked[neighbors[i]]) {
-                marked[neighbors[i]] = true;
-                parent[neighbors[i]] = current;
-                queue_add_last(Q, neighbors[i]);
+        const vertex_t* neighbors;
+        size_t deg;
+        graph_out_edges(G, current, &neighbors, NULL, NULL, &deg);
+        for (size_t e = 0; e < deg; ++e) {
+            vertex_t v = neighbors[e];
+            if (v != start && parent[v] == v) {
+                parent[v] = current;
+                queue_add_last(Q, v);
             }
         }
     }
     queue_destroy(Q);
 }
 
-//private method
-void graph_bfs_marked(graph* G, vertex_t start, bool* marked) {
-    size_t i;
+typedef struct bfs_worker bfs_worker;
+
+// Shared state of a direction optimizing breadth first search. The frontier
+// is a list of vertices while the search steps top-down and a bitset while it
+// steps bottom-up; visited is a bitset throughout. Every worker owns a slice
+// of each and meets the others at a barrier between the phases of a level.
+typedef struct bfs_job {
+    const size_t* offset;          // G, whose edges are stepped forwards
+    const vertex_t* target;
+    const size_t* in_offset;       // its reversal, or NULL to stay top-down
+    const vertex_t* in_target;
+    size_t n;
+    size_t words;                  // 64-bit words in each bitset
+    vertex_t* parent;
+    _Atomic unsigned long long* visited;
+    _Atomic unsigned long long* bits[2];  // frontier, then next frontier
+    vertex_t* list;                // the frontier in top-down order
+    size_t list_count;
+    size_t unexplored;             // edges leaving unvisited vertices
+    bool bottom_up;                // how the coming level is stepped
+    bool solo;                     // whether the first worker steps it alone
+    bool done;
+    atomic_bool failed;
+    bfs_worker* workers;
+    size_t threads;
+
+    // A barrier whose number of threads is only known once they are started
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    pthread_cond_t wake;           // signalled when a solo stretch ends
+    size_t stretch;                // solo stretches ended so far
+    size_t arrived;
+    size_t round;
+} bfs_job;
+
+// One worker of a breadth first search: the vertices it found in the level
+// just stepped, with the number of edges leaving them.
+struct bfs_worker {
+    bfs_job* job;
+    size_t index;
+    vertex_t* found;
+    size_t found_count;
+    size_t found_capacity;
+    size_t found_edges;
+    size_t list_offset;            // where found goes in the next list
+};
+
+// Private helper that waits until every worker of a search has arrived.
+static void bfs_wait(bfs_job* J) {
+    pthread_mutex_lock(&J->lock);
+    size_t round = J->round;
+    if (++J->arrived == J->threads) {
+        J->arrived = 0;
+        J->round++;
+        pthread_cond_broadcast(&J->turn);
+    } else {
+        while (J->round == round) pthread_cond_wait(&J->turn, &J->lock);
+    }
+    pthread_mutex_unlock(&J->lock);
+}
+
+// Private helper returning the first of count items in the share of worker k.
+static size_t bfs_share(size_t count, size_t k, size_t threads) {
+    return count / threads * k + (k < count % threads ? k : count % threads);
+}
+
+// Private helper returning the number of workers sharing the current level.
+static size_t bfs_parts(bfs_job* J) {
+    return J->solo ? 1 : J->threads;
+}
+
+// Private helper recording that a worker found v through parent u.
+static void bfs_found(bfs_worker* W, vertex_t v, vertex_t u) {
+    bfs_job* J = W->job;
+    J->parent[v] = u;
+    W->found_edges += J->offset[v + 1] - J->offset[v];
+    if (W->found_count == W->found_capacity) {
+        size_t cap = W->found_capacity > 0 ? 2 * W->found_capacity : 1024;
+        vertex_t* grown = realloc(W->found, cap * sizeof(vertex_t));
+        if (grown == NULL) {
+            atomic_store(&J->failed, true);
+            return;
+        }
+        W->found = grown;
+        W->found_capacity = cap;
+    }
+    W->found[W->found_count++] = v;
+}
+
+// Private helper stepping a worker's share of the frontier list forwards:
+// each unvisited out-neighbor is claimed by whichever worker sets its bit.
+static void bfs_top_down(bfs_worker* W) {
+    bfs_job* J = W->job;
+    size_t first = bfs_share(J->list_count, W->index, bfs_parts(J));
+    size_t last = bfs_share(J->list_count, W->index + 1, bfs_parts(J));
+    for (size_t i = first; i < last; i++) {
+        vertex_t u = J->list[i];
+        for (size_t e = J->offset[u]; e < J->offset[u + 1]; e++) {
+            vertex_t v = J->target[e];
+            unsigned long long bit = 1ull << (v % 64);
+            if (atomic_load_explicit(&J->visited[v / 64], memory_order_relaxed) & bit) { continue; }
+            if (atomic_fetch_or(&J->visited[v / 64], bit) & bit) { continue; }
+            bfs_found(W, v, u);
+        }
+    }
+}
+
+// Private helper stepping a worker's share of the vertices backwards: each
+// unvisited vertex looks for an in-neighbor on the frontier. The worker owns
+// the words of its share, so it writes them without contention.
+static void bfs_bottom_up(bfs_worker* W) {
+    bfs_job* J = W->job;
+    _Atomic unsigned long long* front = J->bits[0];
+    _Atomic unsigned long long* next = J->bits[1];
+    size_t first = bfs_share(J->words, W->index, bfs_parts(J));
+    size_t last = bfs_share(J->words, W->index + 1, bfs_parts(J));
+    for (size_t w = first; w < last; w++) {
+        unsigned long long seen = atomic_load_explicit(&J->visited[w], memory_order_relaxed);
+        unsigned long long found = 0;
+        for (size_t b = 0; b < 64 && 64 * w + b < J->n; b++) {
+            if (seen & (1ull << b)) { continue; }
+            vertex_t v = 64 * w + b;
+            for (size_t e = J->in_offset[v]; e < J->in_offset[v + 1]; e++) {
+                vertex_t u = J->in_target[e];
+                if (atomic_load_explicit(&front[u / 64], memory_order_relaxed) & (1ull << (u % 64))) {
+                    found |= 1ull << b;
+                    bfs_found(W, v, u);
+                    break;
+                }
+            }
+        }
+        atomic_store_explicit(&next[w], found, memory_order_relaxed);
+        atomic_store_explicit(&J->visited[w], seen | found, memory_order_relaxed);
+    }
+}
+
+// Private helper run by the first worker between levels: totals what the
+// level found and decides how the next one is stepped, and by how many.
+static void bfs_decide(bfs_job* J, bool bottom_up) {
+    size_t parts = bfs_parts(J);
+    size_t count = 0;
+    size_t edges = 0;
+    for (size_t k = 0; k < parts; k++) {
+        J->workers[k].list_offset = count;
+        count += J->workers[k].found_count;
+        edges += J->workers[k].found_edges;
+    }
+    J->unexplored -= edges;
+    J->done = count == 0 || atomic_load(&J->failed);
+    if (J->in_offset != NULL && !bottom_up && edges > J->unexplored / GRAPH_BFS_ALPHA) {
+        J->bottom_up = true;
+    } else if (bottom_up && count < J->n / GRAPH_BFS_BETA) {
+        J->bottom_up = false;
+    }
+    J->solo = J->threads > 1 && !J->bottom_up && count < GRAPH_BFS_PARALLEL_FRONTIER;
+    J->list_count = count;
+    if (bottom_up) {
+        // the next frontier becomes the frontier
+        _Atomic unsigned long long* front = J->bits[0];
+        J->bits[0] = J->bits[1];
+        J->bits[1] = front;
+    }
+}
+
+// Private helper that brings the vertices a worker found into the form the
+// next level steps: the frontier list, or the frontier bitset if the level
+// just stepped top-down. The bitset is cleared before any of the parts
+// workers that stepped the level sets bits.
+static void bfs_convert(bfs_worker* W, bool bottom_up, size_t parts) {
+    bfs_job* J = W->job;
+    if (!J->bottom_up) {
+        memcpy(J->list + W->list_offset, W->found, W->found_count * sizeof(vertex_t));
+    } else if (!bottom_up) {
+        size_t first = bfs_share(J->words, W->index, parts);
+        size_t last = bfs_share(J->words, W->index + 1, parts);
+        for (size_t w = first; w < last; w++) atomic_store_explicit(&J->bits[0][w], 0, memory_order_relaxed);
+        if (parts > 1) bfs_wait(J);
+        for (size_t i = 0; i < W->found_count; i++) {
+            vertex_t v = W->found[i];
+            atomic_fetch_or_explicit(&J->bits[0][v / 64], 1ull << (v % 64), memory_order_relaxed);
+        }
+    }
+}
+
+// Private helper stepping a worker's share of one level.
+static void bfs_level(bfs_worker* W, bool bottom_up) {
+    W->found_count = 0;
+    W->found_edges = 0;
+    if (bottom_up) {
+        bfs_bottom_up(W);
+    } else {
+        bfs_top_down(W);
+    }
+}
+
+// Private function run by every worker: one level per round, each stepped
+// top-down or bottom-up as the first worker decides between rounds from the
+// edges leaving the new frontier and those leaving unvisited vertices.
+// While the frontier is small the first worker steps the levels alone and
+// the others sleep, so a long thin search does not pay for barriers.
+static void* bfs_work(void* arg) {
+    bfs_worker* W = arg;
+    bfs_job* J = W->job;
+
+    bfs_wait(J);
+    size_t first = bfs_share(J->words, W->index, J->threads) * 64;
+    size_t last = bfs_share(J->words, W->index + 1, J->threads) * 64;
+    for (size_t v = first; v < last && v < J->n; v++) J->parent[v] = v;
+    bfs_wait(J);
+
+    while (!J->done) {
+        if (J->solo) {
+            // the others only look at the job again once the stretch is over
+            size_t stretch = J->stretch;
+            bfs_wait(J);
+            if (W->index == 0) {
+                while (!J->done && J->solo) {
+                    bool bottom_up = J->bottom_up;
+                    bfs_level(W, bottom_up);
+                    bfs_decide(J, bottom_up);
+                    if (!J->done) bfs_convert(W, bottom_up, 1);
+                }
+                pthread_mutex_lock(&J->lock);
+                J->solo = false;
+                J->stretch++;
+                pthread_cond_broadcast(&J->wake);
+            } else {
+                pthread_mutex_lock(&J->lock);
+                while (J->stretch == stretch) pthread_cond_wait(&J->wake, &J->lock);
+            }
+            pthread_mutex_unlock(&J->lock);
+            continue;
+        }
+
+        bool bottom_up = J->bottom_up;
+        bfs_level(W, bottom_up);
+        bfs_wait(J);
+        if (W->index == 0) bfs_decide(J, bottom_up);
+        bfs_wait(J);
+        if (J->done) { break; }
+        bfs_convert(W, bottom_up, J->threads);
+        bfs_wait(J);
+    }
+    return NULL;
+}
 
+graph* graph_bfs_parallel(graph* G, graph* R, vertex_t start, vertex_t* parent, size_t threads) {
     size_t n = graph_vertex_count(G);
+    if (start >= n || (R != NULL && graph_vertex_count(R) != n)) { return NULL; }
+    if (R == NULL && !graph_directed(G)) R = G;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+    if (threads > GRAPH_BFS_MAX_THREADS) threads = GRAPH_BFS_MAX_THREADS;
+    if (n < GRAPH_BFS_PARALLEL_VERTICES) threads = 1;
 
-    vertex_t parent[n];
-    for (i = 0; i < n; ++i) {
-        parent[i] = i;
-        marked[i] = false;
+    bfs_job J;
+    memset(&J, 0, sizeof(J));
+    const double* lengths;
+    const double* speeds;
+    graph_storage(G, &J.offset, &J.target, &lengths, &speeds);
+    if (R != NULL) graph_storage(R, &J.in_offset, &J.in_target, &lengths, &speeds);
+    J.n = n;
+    J.words = (n + 63) / 64;
+    J.parent = parent;
+    J.visited = calloc(J.words, sizeof(unsigned long long));
+    J.bits[0] = calloc(J.words, sizeof(unsigned long long));
+    J.bits[1] = calloc(J.words, sizeof(unsigned long long));
+    J.list = malloc((n + 1) * sizeof(vertex_t));
+    J.workers = calloc(threads, sizeof(bfs_worker));
+    bool ok = J.visited != NULL && J.bits[0] != NULL && J.bits[1] != NULL && J.list != NULL && J.workers != NULL
+        && pthread_mutex_init(&J.lock, NULL) == 0;
+    if (ok && pthread_cond_init(&J.turn, NULL) != 0) {
+        pthread_mutex_destroy(&J.lock);
+        ok = false;
+    }
+    if (ok && pthread_cond_init(&J.wake, NULL) != 0) {
+        pthread_cond_destroy(&J.turn);
+        pthread_mutex_destroy(&J.lock);
+        ok = false;
     }
 
-    marked[start] = true;
-    queue* Q = queue_create();
-    queue_add_last(Q, start);
+    if (ok) {
+        atomic_store(&J.visited[start / 64], 1ull << (start % 64));
+        J.list[0] = start;
+        J.list_count = 1;
+        J.unexplored = J.offset[n] - (J.offset[start + 1] - J.offset[start]);
 
-    while (!queue_empty(Q)) {
-        // vertex_t current = first elt in Q
-        vertex_t current;
-        queue_get_first(Q, &current);
-        queue_remove_first(Q);
+        // The workers wait at the first barrier until it is known how many
+        // could be started, which is the number that then share the work
+        J.threads = SIZE_MAX;
+        pthread_t thread[GRAPH_BFS_MAX_THREADS];
+        size_t started = 1;
+        for (; started < threads; started++) {
+            J.workers[started].job = &J;
+            J.workers[started].index = started;
+            if (pthread_create(&thread[started], NULL, bfs_work, &J.workers[started]) != 0) { break; }
+        }
+        pthread_mutex_lock(&J.lock);
+        J.threads = started;
+        J.solo = true;
+        pthread_mutex_unlock(&J.lock);
+        J.workers[0].job = &J;
+        bfs_work(&J.workers[0]);
+        for (size_t k = 1; k < started; k++) pthread_join(thread[k], NULL);
+        ok = !atomic_load(&J.failed);
+        pthread_cond_destroy(&J.wake);
+        pthread_cond_destroy(&J.turn);
+        pthread_mutex_destroy(&J.lock);
+    }
+
+    for (size_t k = 0; J.workers != NULL && k < threads; k++) free(J.workers[k].found);
+    free(J.workers);
+    free((void*)J.visited);
+    free((void*)J.bits[0]);
+    free((void*)J.bits[1]);
+    free(J.list);
+    return ok ? G : NULL;
+}
+
+graph* graph_strong_components(graph* G, vertex_t* component, size_t* count) {
+    size_t n = graph_vertex_count(G);
+    vertex_t* index = malloc((n + 1) * sizeof(vertex_t));
+    vertex_t* low = malloc((n + 1) * sizeof(vertex_t));
+    vertex_t* stack = malloc((n + 1) * sizeof(vertex_t));
+    vertex_t* path = malloc((n + 1) * sizeof(vertex_t));
+    size_t* next = malloc((n + 1) * sizeof(size_t));
+    if (index == NULL || low == NULL || stack == NULL || path == NULL || next == NULL) {
+        free(index);
+        free(low);
+        free(stack);
+        free(path);
+        free(next);
+        return NULL;
+    }
+
+    const size_t* offset;
+    const vertex_t* target;
+    const double* lengths;
+    const double* speeds;
+    graph_storage(G, &offset, &target, &lengths, &speeds);
+
+    // A vertex is unvisited while its index is n, and on the stack while it
+    // is visited but its component is still n
+    for (vertex_t v = 0; v < n; v++) {
+        index[v] = n;
+        component[v] = n;
+    }
+
+    // Tarjan's algorithm, with the recursion kept on path: each vertex on it
+    // remembers in next the first of its edges not yet followed
+    size_t visited = 0;
+    size_t top = 0;
+    size_t components = 0;
+    for (vertex_t root = 0; root < n; root++) {
+        if (index[root] != n) { continue; }
+        size_t depth = 0;
+        index[root] = low[root] = visited++;
+        next[root] = offset[root];
+        stack[top++] = root;
+        path[depth++] = root;
+
+        while (depth > 0) {
+            vertex_t v = path[depth - 1];
+            if (next[v] < offset[v + 1]) {
+                vertex_t w = target[next[v]++];
+                if (index[w] == n) {
+                    index[w] = low[w] = visited++;
+                    next[w] = offset[w];
+                    stack[top++] = w;
+                    path[depth++] = w;
+                } else if (component[w] == n && index[w] < low[v]) {
+                    low[v] = index[w];
+                }
+                continue;
+            }
 
-        // vertex_t neighbors[n] = neighbors of current
-        size_t current_deg;
-        graph_degree(G, current, &current_deg);
-        vertex_t neighbors[n];
-        graph_neighbors(G, current, neighbors);
-
-        for (i = 0; i < current_deg; ++i) {
-            if (!marked[neighbors[i]]) {
-                marked[neighbors[i]] = true;
-                parent[neighbors[i]] = current;
-                queue_add_last(Q, neighbors[i]);
+            // every edge of v is done, so return to its parent
+            depth--;
+            if (depth > 0 && low[v] < low[path[depth - 1]]) {
+                low[path[depth - 1]] = low[v];
+            }
+            if (low[v] == index[v]) {
+                vertex_t w;
+                do {
+                    w = stack[--top];
+                    component[w] = components;
+                } while (w != v);
+                components++;
             }
         }
     }
-    queue_destroy(Q);
+
+    free(index);
+    free(low);
+    free(stack);
+    free(path);
+    free(next);
+    *count = components;
+    return G;
 }
 
 bool graph_is_connected(graph* G){
     size_t n = graph_vertex_count(G);
-    bool marked[n];
-    bool markedrev[n];
+    vertex_t* component = malloc((n + 1) * sizeof(vertex_t));
+    size_t count = 0;
+    // Treat running out of memory as not knowing, which is not connected
+    bool connected = component != NULL && graph_strong_components(G, component, &count) != NULL && count <= 1;
+    free(component);
+    return connected;
+}
+
+double graph_metric_cost(double distance, double speed, char metric) {
+    double cost = metric == 'T' ? distance / speed : distance;
+    return cost > 0.0 ? cost : 0.0;
+}
 
-    graph_bfs_marked(G,0,marked);
-    graph* revg = graph_edge_reversal(G);
-    graph_bfs_marked(revg,0,markedrev);
-    graph_destroy(revg);
+// Distance of vertices a search has not reached.
+static const double unreached = 10000000000000.0;
 
-    for (size_t i = 0; i < n; i++){
-        if (marked[i] == false || markedrev[i] == false) {
-            return false;
+// One direction of a shortest path search: the graph it walks, its frontier,
+// and its per-vertex distance, settled flag and parent arrays.
+// An A* side also carries the landmarks that estimate the distance left to
+// goal, and queues every vertex by its distance plus that estimate.
+// A side with stamps keeps its arrays from one search to the next: an entry
+// only counts while its stamp equals the side's generation, and everything
+// else reads as unreached, so starting over costs one increment.
+typedef struct search_side {
+    graph* G;
+    frontier queue;
+    double* distance;
+    bool* settled;
+    vertex_t* parent;
+    unsigned* stamp;
+    unsigned generation;
+    vertex_t origin;
+    landmarks* guide;
+    vertex_t goal;
+    double popped_key;
+} search_side;
+
+// Private helper that resets a side to a search from start over G, using the
+// caller's arrays of n entries.
+static bool side_init(search_side* S, graph* G, vertex_t start, double* distance, bool* settled, vertex_t* parent) {
+    size_t n = graph_vertex_count(G);
+    S->G = G;
+    S->distance = distance;
+    S->settled = settled;
+    S->parent = parent;
+    S->stamp = NULL;
+    S->generation = 0;
+    S->origin = start;
+    S->guide = NULL;
+    S->goal = start;
+    S->popped_key = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        parent[i] = start;
+        settled[i] = false;
+        distance[i] = unreached;
+    }
+    distance[start] = 0.0;
+    return frontier_init(&S->queue, n) && frontier_push(&S->queue, start, 0.0);
+}
+
+// Private helper freeing what a side allocated.
+static void side_destroy(search_side* S) {
+    frontier_destroy(&S->queue);
+}
+
+// Private helper that makes v part of the current search of a side with
+// stamps, unreached until relaxed.
+static inline void side_touch(search_side* S, vertex_t v) {
+    if (S->stamp != NULL && S->stamp[v] != S->generation) {
+        S->stamp[v] = S->generation;
+        S->distance[v] = unreached;
+        S->settled[v] = false;
+        S->parent[v] = S->origin;
+    }
+}
+
+// Private helper returning the distance of v in the current search.
+static inline double side_distance(const search_side* S, vertex_t v) {
+    return S->stamp == NULL || S->stamp[v] == S->generation ? S->distance[v] : unreached;
+}
+
+// Private helper returning whether v is settled in the current search.
+static inline bool side_settled(const search_side* S, vertex_t v) {
+    return (S->stamp == NULL || S->stamp[v] == S->generation) && S->settled[v];
+}
+
+// Private helper that sets up a side with arrays and stamps of its own for
+// the vertices of G; returns false if memory allocation failed.
+static bool side_open(search_side* S, graph* G) {
+    size_t n = graph_vertex_count(G);
+    memset(S, 0, sizeof(search_side));
+    S->G = G;
+    S->distance = malloc((n + 1) * sizeof(double));
+    S->settled = malloc(n + 1);
+    S->parent = malloc((n + 1) * sizeof(vertex_t));
+    S->stamp = calloc(n + 1, sizeof(unsigned));
+    bool ok = frontier_init(&S->queue, n);
+    return ok && S->distance != NULL && S->settled != NULL && S->parent != NULL && S->stamp != NULL;
+}
+
+// Private helper freeing a side set up by side_open.
+static void side_close(search_side* S) {
+    side_destroy(S);
+    free(S->distance);
+    free(S->settled);
+    free(S->parent);
+    free(S->stamp);
+}
+
+// Private helper that starts a new search from start over G on a side set up
+// by side_open, in O(1) apart from emptying the frontier.
+static bool side_restart(search_side* S, graph* G, vertex_t start) {
+    if (++S->generation == 0) {
+        // the stamps wrapped around, so clear them once in 2^32 searches
+        memset(S->stamp, 0, (graph_vertex_count(G) + 1) * sizeof(unsigned));
+        S->generation = 1;
+    }
+    if (S->queue.kind == GRAPH_QUEUE_RADIX) {
+        rheap_clear(&S->queue.radix);
+    } else {
+        pqueue_clear(&S->queue.heap);
+    }
+    S->G = G;
+    S->origin = start;
+    S->guide = NULL;
+    S->goal = start;
+    S->popped_key = 0.0;
+    side_touch(S, start);
+    S->distance[start] = 0.0;
+    return frontier_push(&S->queue, start, 0.0);
+}
+
+// Private helper that relaxes the outgoing edges of the newly settled vertex
+// current. When other is given (the opposite side of a bidirectional search),
+// every vertex both sides have reached is a candidate meeting point, and the
+// best one is kept in *best and *meet.
+static bool side_relax(search_side* S, vertex_t current, char metric, search_side* other, double* best, vertex_t* meet) {
+    size_t i;
+
+    // neighbors of current, with their edge weights, read in place
+    const vertex_t* neighbors;
+    const double* lengths;
+    const double* speeds;
+    size_t current_deg;
+    graph_out_edges(S->G, current, &neighbors, &lengths, &speeds, &current_deg);
+
+    for (i = 0; i < current_deg; ++i) {
+        side_touch(S, neighbors[i]);
+        if (!S->settled[neighbors[i]]) {
+            double new_dist = S->distance[current] + graph_metric_cost(lengths[i], speeds[i], metric);
+            if (new_dist < S->distance[neighbors[i]]){
+                S->distance[neighbors[i]] = new_dist;
+                S->parent[neighbors[i]] = current;
+                double key = new_dist;
+                if (S->guide != NULL) {
+                    // The landmark estimate is consistent, so this is never
+                    // below the key current was popped with; clamping only
+                    // absorbs rounding, which the radix heap would reject.
+                    key += landmarks_bound(S->guide, neighbors[i], S->goal);
+                    key = fmax(key, S->popped_key);
+                }
+                if (!frontier_push(&S->queue, neighbors[i], key)){
+                    return false;
+                }
+            }
+        }
+        if (other != NULL && side_distance(other, neighbors[i]) < unreached) {
+            double through = S->distance[neighbors[i]] + side_distance(other, neighbors[i]);
+            if (through < *best) {
+                *best = through;
+                *meet = neighbors[i];
+            }
         }
     }
     return true;
 }
 
-void graph_dijkstras(graph* G, vertex_t start, vertex_t* parent, double** edge_length){
-    size_t i;
+// Private helper running Dijkstra's algorithm from start. The search stops
+// as soon as target is settled; pass a target of n or more to settle the
+// whole graph. When distance is given it receives the final distances.
+static graph* dijkstras_search(graph* G, vertex_t start, vertex_t target, vertex_t* parent, double* distance, char metric){
     size_t n = graph_vertex_count(G);
-    double distance[n];
-    bool marked[n];
-    bool in_pq = false;
+    double* own_distance = distance == NULL ? malloc((n + 1) * sizeof(double)) : NULL;
+    bool* marked = malloc(n + 1);
+    if (marked == NULL || (distance == NULL && own_distance == NULL)) {
+        free(own_distance);
+        free(marked);
+        return NULL;
+    }
 
-    for (i = 0; i < n; ++i) {
-        parent[i] = start;
-        marked[i] = false;
-        distance[i] = 10000000000000.0;
+    search_side S;
+    bool ok = side_init(&S, G, start, distance == NULL ? own_distance : distance, marked, parent);
+
+    // vertex_t current = closest unsettled vertex, which is now settled
+    vertex_t current;
+    while (ok && frontier_pop(&S.queue, marked, &current)) {
+        marked[current] = true;
+        if (current == target) { break; }
+        ok = side_relax(&S, current, metric, NULL, NULL, NULL);
     }
+    side_destroy(&S);
+    free(own_distance);
+    free(marked);
+    return ok ? G : NULL;
+}
 
-    distance[start] = 0.0;
-    marked[start] = true;
+graph* graph_dijkstras(graph* G, vertex_t start, vertex_t* parent, char metric){
+    return dijkstras_search(G, start, graph_vertex_count(G), parent, NULL, metric);
+}
+
+graph* graph_dijkstras_distances(graph* G, vertex_t start, double* distance, char metric){
+    size_t n = graph_vertex_count(G);
+    vertex_t* parent = malloc((n + 1) * sizeof(vertex_t));
+    if (parent == NULL || dijkstras_search(G, start, n, parent, distance, metric) == NULL) {
+        free(parent);
+        return NULL;
+    }
+    free(parent);
+    for (size_t i = 0; i < n; ++i) {
+        if (distance[i] >= unreached) distance[i] = INFINITY;
+    }
+    return G;
+}
 
-    pqueue* pq = malloc(sizeof(pqueue));
-    pqueue_init(pq);
-    pqueue_push(pq, start, distance[start]);
+// Private helper that copies the parents on the path from start to end out
+// of a search, for the searches that write the caller's array.
+static void copy_path(const vertex_t* from, vertex_t start, vertex_t end, vertex_t* parent) {
+    parent[start] = start;
+    for (vertex_t v = end; v != start; v = from[v]) {
+        parent[v] = from[v];
+    }
+}
 
-    while (!pqueue_empty(pq)) {
-        // vertex_t current = first elt in Q
-        vertex_t current;
-        double current_priority;
-        pqueue_top(pq, &current, &current_priority);
-        pqueue_pop(pq);
-
-        // vertex_t neighbors[n] = neighbors of current
-        size_t current_deg;
-        graph_degree(G, current, &current_deg);
-        vertex_t neighbors[n];
-        graph_neighbors(G, current, neighbors);
-
-        for (i = 0; i < current_deg; ++i) {
-            if (!marked[neighbors[i]]) {
-                marked[neighbors[i]] = true;
-
-                double addition = edge_length[current][neighbors[i]] > 0.0 ? edge_length[current][neighbors[i]] : 0.0;
-                double new_dist = distance[current] + addition;
-                if (new_dist < distance[neighbors[i]]){
-                    distance[neighbors[i]] = new_dist;
-                    parent[neighbors[i]] = current;
-
-                    in_pq = false;
-                    for (size_t i = 0; i < pqueue_size(pq); i++){
-                        if (pq->heap[i].key == neighbors[i]) {
-                            in_pq = true;
-                        }
-                    }
-                    if (in_pq){
-                        pqueue_adjust_priority(pq,neighbors[i], new_dist);
-                    } else{
-                        pqueue_push(pq, neighbors[i], new_dist);
-                    }
-                }
+graph* graph_dijkstras_to(graph* G, vertex_t start, vertex_t end, vertex_t* parent, char metric){
+    if (end >= graph_vertex_count(G)) { return NULL; }
+    graph_search* search = graph_search_create(G);
+    const vertex_t* found;
+    graph* ok = search != NULL ? graph_search_to(search, start, end, metric, &found) : NULL;
+    if (ok != NULL) copy_path(found, start, end, parent);
+    if (search != NULL) graph_search_destroy(search);
+    return ok;
+}
+
+// A search that is live holds a Dijkstra search from start in metric on
+// side[0], whose settled vertices have all been relaxed, so it can go on at
+// any time. The other searches leave it not live. side[1] is the backward
+// side of bidirectional searches, set up on first use, and fifo the queue of
+// breadth first searches.
+struct graph_search {
+    graph* G;
+    search_side side[2];
+    bool backward;
+    vertex_t* fifo;
+    vertex_t start;
+    char metric;
+    bool live;
+    bool found;      // the last point to point query reached its end
+};
+
+graph_search* graph_search_create(graph* G) {
+    graph_search* self = calloc(1, sizeof(graph_search));
+    if (self == NULL) { return NULL; }
+    self->G = G;
+    if (!side_open(&self->side[0], G)) {
+        side_close(&self->side[0]);
+        free(self);
+        return NULL;
+    }
+    return self;
+}
+
+void graph_search_destroy(graph_search* self) {
+    side_close(&self->side[0]);
+    if (self->backward) side_close(&self->side[1]);
+    free(self->fifo);
+    free(self);
+}
+
+bool graph_search_from(graph_search* self, vertex_t start, char metric) {
+    return self->live && self->start == start && self->metric == metric;
+}
+
+// Private helper that points the parent of an end no search reached at start,
+// as a search over whole arrays leaves it.
+static void unreached_end(search_side* S, vertex_t start, vertex_t end) {
+    if (side_distance(S, end) >= unreached) S->parent[end] = start;
+}
+
+graph* graph_search_to(graph_search* self, vertex_t start, vertex_t end, char metric, const vertex_t** parent) {
+    if (end >= graph_vertex_count(self->G)) { return NULL; }
+    search_side* S = &self->side[0];
+    if (!graph_search_from(self, start, metric)) {
+        self->live = true;
+        self->start = start;
+        self->metric = metric;
+        if (!side_restart(S, self->G, start)) {
+            self->live = false;
+            return NULL;
+        }
+    }
+
+    // Unlike dijkstras_search, end is relaxed too once settled, so that a
+    // later query can carry on from here
+    vertex_t current;
+    while (!side_settled(S, end) && frontier_pop(&S->queue, S->settled, &current)) {
+        S->settled[current] = true;
+        if (!side_relax(S, current, metric, NULL, NULL, NULL)) {
+            self->live = false;
+            return NULL;
+        }
+    }
+    self->found = side_settled(S, end);
+    unreached_end(S, start, end);
+    *parent = S->parent;
+    return self->G;
+}
+
+graph* graph_search_astar(graph_search* self, landmarks* L, vertex_t start, vertex_t end, char metric,
+        const vertex_t** parent) {
+    size_t n = graph_vertex_count(self->G);
+    if (end >= n || L->n != n || L->metric != metric) { return NULL; }
+    search_side* S = &self->side[0];
+    self->live = false;
+    if (!side_restart(S, self->G, start)) { return NULL; }
+    S->guide = L;
+    S->goal = end;
+
+    // With a consistent estimate a vertex is final once popped, as in Dijkstra
+    vertex_t current;
+    while (frontier_peek(&S->queue, S->settled, &current, &S->popped_key)) {
+        frontier_pop(&S->queue, S->settled, &current);
+        S->settled[current] = true;
+        if (current == end) { break; }
+        if (!side_relax(S, current, metric, NULL, NULL, NULL)) { return NULL; }
+    }
+    self->found = side_settled(S, end);
+    unreached_end(S, start, end);
+    *parent = S->parent;
+    return self->G;
+}
+
+graph* graph_astar(graph* G, landmarks* L, vertex_t start, vertex_t end, vertex_t* parent, char metric){
+    size_t n = graph_vertex_count(G);
+    if (end >= n || L->n != n || L->metric != metric) { return NULL; }
+    graph_search* search = graph_search_create(G);
+    const vertex_t* found;
+    graph* ok = search != NULL ? graph_search_astar(search, L, start, end, metric, &found) : NULL;
+    if (ok != NULL) copy_path(found, start, end, parent);
+    if (search != NULL) graph_search_destroy(search);
+    return ok;
+}
+
+graph* graph_distance_table(graph* G, const vertex_t* sources, size_t source_count, const vertex_t* targets,
+        size_t target_count, char metric, double* table, size_t threads, ch** hierarchy) {
+    ch* H = hierarchy != NULL ? *hierarchy : NULL;
+    if (H != NULL && (H->n != graph_vertex_count(G) || H->metric != metric)) { return NULL; }
+    if (H == NULL) {
+        H = ch_create(G, metric);
+        if (H == NULL) { return NULL; }
+    }
+    ch* ok = ch_table(H, sources, source_count, targets, target_count, table, threads);
+    if (hierarchy != NULL) {
+        *hierarchy = H;
+    } else {
+        ch_destroy(H);
+    }
+    return ok != NULL ? G : NULL;
+}
+
+graph* graph_search_bidirectional(graph_search* self, graph* R, vertex_t start, vertex_t end, char metric,
+        const vertex_t** parent) {
+    size_t n = graph_vertex_count(self->G);
+    if (end >= n || graph_vertex_count(R) != n) { return NULL; }
+    if (!self->backward) {
+        self->backward = true;
+        if (!side_open(&self->side[1], R)) {
+            side_close(&self->side[1]);
+            self->backward = false;
+            return NULL;
+        }
+    }
+    search_side* forward = &self->side[0];
+    search_side* backward = &self->side[1];
+    self->live = false;
+    if (!side_restart(forward, self->G, start) || !side_restart(backward, R, end)) { return NULL; }
+
+    double best = start == end ? 0.0 : unreached;
+    vertex_t meet = start;
+
+    // Grow whichever side has the closer frontier. Once the two frontiers
+    // together are at least as far as the best meeting found, no unsettled
+    // vertex can lie on a shorter path.
+    bool ok = true;
+    while (ok) {
+        vertex_t u;
+        vertex_t v;
+        double du;
+        double dv;
+        if (!frontier_peek(&forward->queue, forward->settled, &u, &du)) { break; }
+        if (!frontier_peek(&backward->queue, backward->settled, &v, &dv)) { break; }
+        if (du + dv >= best) { break; }
+
+        if (du <= dv) {
+            frontier_pop(&forward->queue, forward->settled, &u);
+            forward->settled[u] = true;
+            ok = side_relax(forward, u, metric, backward, &best, &meet);
+        } else {
+            frontier_pop(&backward->queue, backward->settled, &v);
+            backward->settled[v] = true;
+            ok = side_relax(backward, v, metric, forward, &best, &meet);
+        }
+    }
+    if (!ok) { return NULL; }
+    self->found = best < unreached;
+
+    // Splice the backward half onto the forward parents: walking from the
+    // meeting vertex towards end, each step becomes the parent of the next.
+    if (best < unreached) {
+        for (vertex_t v = meet; v != end; v = backward->parent[v]) {
+            forward->parent[backward->parent[v]] = v;
+        }
+    } else {
+        forward->parent[end] = start;
+    }
+    *parent = forward->parent;
+    return self->G;
+}
+
+graph* graph_bidirectional_dijkstras(graph* G, graph* R, vertex_t start, vertex_t end, vertex_t* parent, char metric){
+    size_t n = graph_vertex_count(G);
+    if (end >= n || graph_vertex_count(R) != n) { return NULL; }
+    graph_search* search = graph_search_create(G);
+    const vertex_t* found;
+    graph* ok = search != NULL ? graph_search_bidirectional(search, R, start, end, metric, &found) : NULL;
+    if (ok != NULL) copy_path(found, start, end, parent);
+    if (search != NULL) graph_search_destroy(search);
+    return ok;
+}
+
+graph* graph_search_bfs(graph_search* self, vertex_t start, const vertex_t** parent) {
+    size_t n = graph_vertex_count(self->G);
+    if (start >= n) { return NULL; }
+    if (self->fifo == NULL) {
+        self->fifo = malloc((n + 1) * sizeof(vertex_t));
+        if (self->fifo == NULL) { return NULL; }
+    }
+    search_side* S = &self->side[0];
+    self->live = false;
+    if (!side_restart(S, self->G, start)) { return NULL; }
+
+    // Every vertex enters the queue once, so an array of n holds it
+    size_t head = 0;
+    size_t tail = 0;
+    S->settled[start] = true;
+    self->fifo[tail++] = start;
+    while (head < tail) {
+        vertex_t current = self->fifo[head++];
+        const vertex_t* neighbors;
+        size_t deg;
+        graph_out_edges(self->G, current, &neighbors, NULL, NULL, &deg);
+        for (size_t e = 0; e < deg; ++e) {
+            vertex_t v = neighbors[e];
+            side_touch(S, v);
+            if (!S->settled[v]) {
+                S->settled[v] = true;
+                S->parent[v] = current;
+                self->fifo[tail++] = v;
             }
         }
     }
-    free(pq);
+    *parent = S->parent;
+    return self->G;
+}
+
+bool graph_search_reached(graph_search* self, vertex_t v) {
+    return side_settled(&self->side[0], v);
 }
 
-void graph_traverse_parents(vertex_t* parent, vertex_t start, vertex_t end, vertex_t* path, int* path_size){
+bool graph_search_found(graph_search* self) {
+    return self->found;
+}
+
+void graph_traverse_parents(const vertex_t* parent, vertex_t start, vertex_t end, vertex_t* path, int* path_size){
+    if (start == end){ // the trip is a single location
+        path[0] = start;
+        *path_size = 1;
+        return;
+    }
+
     int count = 2;
     vertex_t current = parent[end];
     while (current != start){
@@ -184,20 +1044,11 @@ void graph_traverse_parents(vertex_t* parent, vertex_t start, vertex_t end, vert
         count++;
     }
 
+    // Fill the path from its end, walking the parents back to start
     *path_size = count;
-    vertex_t revpath[count];
-
-    revpath[0] = end;
-    count = 1;
-    current = parent[end];
-    while (current != start){
-        revpath[count] = current;
+    current = end;
+    for (int i = count - 1; i >= 0; i--){
+        path[i] = current;
         current = parent[current];
-        count++;
-    }
-    revpath[count] = start;
-
-    for (int i = count; i >= 0; i--){
-        path[count-i] = revpath[i];
     }
 }
@@ -2,6 +2,54 @@
 #define __GRAPH_LIB_H__
 
 #include "graph.h"
+#include "ch.h"
+#include "landmarks.h"
+
+// Graphs with fewer vertices are searched by graph_bfs_parallel on the
+// calling thread alone.
+#ifndef GRAPH_BFS_PARALLEL_VERTICES
+#define GRAPH_BFS_PARALLEL_VERTICES 65536
+#endif
+
+// Top-down levels of graph_bfs_parallel whose frontier has fewer vertices
+// are stepped by the calling thread alone.
+#ifndef GRAPH_BFS_PARALLEL_FRONTIER
+#define GRAPH_BFS_PARALLEL_FRONTIER 4096
+#endif
+
+// Most threads graph_bfs_parallel runs on.
+#define GRAPH_BFS_MAX_THREADS 64
+
+// graph_bfs_parallel steps bottom-up once the edges leaving the frontier are
+// more than 1/GRAPH_BFS_ALPHA of those leaving unvisited vertices, and back
+// top-down once the frontier holds less than 1/GRAPH_BFS_BETA of the vertices.
+#ifndef GRAPH_BFS_ALPHA
+#define GRAPH_BFS_ALPHA 14
+#endif
+#ifndef GRAPH_BFS_BETA
+#define GRAPH_BFS_BETA 24
+#endif
+
+/**
+* The priority queues a shortest path search can keep its frontier in.
+*
+* GRAPH_QUEUE_HEAP  the indexed d-ary heap of pqueue.h (the default)
+* GRAPH_QUEUE_RADIX the monotone radix heap of rheap.h, which orders vertices
+*                   by fixed point distances
+*/
+typedef enum graph_queue {
+    GRAPH_QUEUE_HEAP,
+    GRAPH_QUEUE_RADIX
+} graph_queue;
+
+/**
+* Selects the priority queue used by every later shortest path search.
+*
+* Note: this is a process wide setting; change it before searches start.
+*
+* @param kind the priority queue to use
+*/
+void graph_set_queue(graph_queue kind);
 
 /**
 * Takes an input graph and produces a new graph with all edge directions reversed.
@@ -13,6 +61,18 @@
 */
 graph* graph_edge_reversal(graph* G);
 
+/**
+* Gives the cost of traversing a road under a trip metric: miles for 'D' and
+* hours for 'T'. Every search in this library weighs edges this way; negative
+* or undefined costs count as zero.
+*
+* @param  distance the length of the road
+* @param  speed    the speed of the road
+* @param  metric   'D' for distance or 'T' for time
+* @return          the cost of the road
+*/
+double graph_metric_cost(double distance, double speed, char metric);
+
 /**
 * Performs a BFS without restart.
 *
@@ -27,7 +87,61 @@ graph* graph_edge_reversal(graph* G);
 void graph_bfs(graph* G, vertex_t start, vertex_t* parent);
 
 /**
-* determines weather a graph is connected
+* Parallel version of graph_bfs, with the same output: the parent of every
+* reached vertex is one level closer to start, and start and the vertices not
+* reached are their own parents. Which of several parents one level closer a
+* vertex gets is not fixed.
+*
+* The search is level synchronous. A level is stepped top-down while the
+* frontier is small: the threads split the frontier and claim its unvisited
+* out-neighbors in a visited bitset. Once the frontier has many edges it is
+* stepped bottom-up: the threads split the vertices, and each unvisited one
+* scans its in-neighbors in R for one on the frontier bitset, stopping at the
+* first. See GRAPH_BFS_ALPHA and GRAPH_BFS_BETA.
+*
+* Runtime: O(n + m) per thread in the worst case, far less on the levels
+* stepped bottom-up
+* Memory: O(n)
+*
+* @param G           the graph to search
+* @param R           the edge reversal of G, needed to step bottom-up; NULL
+*                    steps top-down only, unless G is undirected
+* @param start       vertex to start the search with
+* @param parent[out] the output array of parents
+* @param threads     the threads to use, 0 for one per online core; at most
+*                    GRAPH_BFS_MAX_THREADS, and one for graphs with fewer
+*                    than GRAPH_BFS_PARALLEL_VERTICES vertices
+* @return            G, or NULL if start is not a vertex of G, R does not
+*                    match G, or memory allocation failed
+*/
+graph* graph_bfs_parallel(graph* G, graph* R, vertex_t start, vertex_t* parent, size_t threads);
+
+/**
+* Labels the strongly connected components of a graph: two vertices share a
+* label exactly when each can be reached from the other.
+*
+* Uses an iterative version of Tarjan's algorithm over the CSR arrays, so no
+* reversed graph is built. Components are numbered in the order they are
+* completed, which is a reverse topological order: an edge between different
+* components always goes from the higher label to the lower. So end cannot be
+* reached from start when component[start] < component[end], and can be when
+* the labels are equal. When component[start] > component[end] the labels
+* leave it open: the order only says which way a path could go, so such a
+* pair still needs a search to tell.
+*
+* Runtime: O(n + m)
+* Memory: O(n)
+*
+* @param  G              the graph to label
+* @param  component[out] the label of every vertex, from 0 to *count - 1
+* @param  count[out]     the number of components
+* @return                G, or NULL if memory allocation failed
+*/
+graph* graph_strong_components(graph* G, vertex_t* component, size_t* count);
+
+/**
+* determines weather a graph is connected: strongly connected, for a directed
+* graph, by way of graph_strong_components
 *
 * @param  G the graph to test
 * @return   boolean. true if connected, false if not connected
@@ -37,12 +151,248 @@ bool graph_is_connected(graph* G);
 /**
 * dijkstras algorithm for finding the shortest path in the map. This function returns the list of parents which represnt the shortest paths.
 *
+* Edge weights are read from the edges themselves: their distance when metric
+* is 'D', and their travel time (distance / speed) when metric is 'T'.
+*
 * @param G           the graph to search
 * @param start       the starting vertext
 * @param parent[out] the output array of parents
-* @param edge_length the 2D array of edge_lengths (weights) for the graph to determine the shortest path.
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @return            G, or NULL if memory for the search could not be allocated
+*/
+graph* graph_dijkstras(graph* G, vertex_t start, vertex_t* parent, char metric);
+
+/**
+* Runs graph_dijkstras from start and reports the distance to every vertex
+* instead of the parents.
+*
+* @param G             the graph to search
+* @param start         the starting vertex
+* @param distance[out] the shortest distance to every vertex, or INFINITY for
+*                      vertices that cannot be reached
+* @param metric        'D' to measure distance or 'T' to measure time
+* @return              G, or NULL if memory for the search could not be allocated
+*/
+graph* graph_dijkstras_distances(graph* G, vertex_t start, double* distance, char metric);
+
+/**
+* Point to point version of graph_dijkstras: the search stops as soon as end is
+* settled, so only the vertices closer to start than end are visited.
+*
+* The parents on the path from start to end are final, which is all
+* graph_traverse_parents needs; the entries of vertices that were not settled
+* should not be relied on.
+*
+* @param G           the graph to search
+* @param start       the starting vertex
+* @param end         the vertex the search is for
+* @param parent[out] the output array of parents
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @return            G, or NULL if end is not a vertex of G or memory for the
+*                    search could not be allocated
+*/
+graph* graph_dijkstras_to(graph* G, vertex_t start, vertex_t end, vertex_t* parent, char metric);
+
+/**
+* Bidirectional version of graph_dijkstras_to. A forward search from start on
+* G and a backward search from end on R, the reversal of G, grow towards each
+* other, and the search stops once the two frontiers together are as far as
+* the best path found through a vertex both have reached. This settles
+* roughly half as many vertices as a one-sided search.
+*
+* R should be built once per map with graph_edge_reversal and reused for
+* every query. The parents are spliced together so that the output feeds
+* graph_traverse_parents exactly like that of graph_dijkstras_to.
+*
+* @param G           the graph to search
+* @param R           the edge reversal of G
+* @param start       the starting vertex
+* @param end         the vertex the search is for
+* @param parent[out] the output array of parents
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @return            G, or NULL if end is not a vertex of G, R does not match G,
+*                    or memory for the search could not be allocated
+*/
+graph* graph_bidirectional_dijkstras(graph* G, graph* R, vertex_t start, vertex_t end, vertex_t* parent, char metric);
+
+/**
+* A* version of graph_dijkstras_to, guided by landmark lower bounds. Vertices
+* are taken in order of their distance from start plus the landmark estimate
+* of their distance to end, so the search heads towards end and settles far
+* fewer vertices than Dijkstra on large maps. The paths found are still
+* shortest paths.
+*
+* @param G           the graph to search
+* @param L           landmarks of G built for the same metric
+* @param start       the starting vertex
+* @param end         the vertex the search is for
+* @param parent[out] the output array of parents
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @return            G, or NULL if end is not a vertex of G, L was built for a
+*                    different map or metric, or memory for the search could
+*                    not be allocated
+*/
+graph* graph_astar(graph* G, landmarks* L, vertex_t start, vertex_t end, vertex_t* parent, char metric);
+
+/**
+* Computes the cost of a shortest path from every source to every target, for
+* an origin x destination matrix such as depots x stops. The matrix comes from
+* ch_table on a contraction hierarchy of G, which costs far less than a
+* Dijkstra search per source once the hierarchy is built.
+*
+* The hierarchy is built here unless one is passed in. Building it dominates
+* a single small table, so callers asking for several tables should keep it.
+*
+* @param G               the graph to search
+* @param sources         the origins
+* @param source_count    the number of origins, s
+* @param targets         the destinations
+* @param target_count    the number of destinations, t
+* @param metric          'D' for distances or 'T' for travel times
+* @param table[out]      s * t entries; table[i * t + j] receives the cost from
+*                        sources[i] to targets[j], or INFINITY if there is no
+*                        path
+* @param threads         the threads to use, 0 for one per online core
+* @param hierarchy[in,out] a hierarchy of G for metric to reuse, or one holding
+*                        NULL to be given the hierarchy built; NULL to build
+*                        one for this call only
+* @return                G, or NULL if a source or target is not a vertex of G,
+*                        the hierarchy passed in is for another map or
+*                        metric, or memory allocation failed
+*/
+graph* graph_distance_table(graph* G, const vertex_t* sources, size_t source_count, const vertex_t* targets,
+        size_t target_count, char metric, double* table, size_t threads, ch** hierarchy);
+
+/**
+* A search context kept between queries: per-vertex distance, settled and
+* parent arrays and the frontier. The arrays are never cleared. Each entry
+* carries the number of the search that wrote it and counts as unreached in
+* any other, so starting a new search costs O(1) and a query costs time in
+* proportion to the vertices it visits.
+*
+* A context belongs to one thread at a time. A Dijkstra query from the same
+* start in the same metric as the one before continues that search from
+* where it stopped, so a run of trips leaving one place settles every vertex
+* at most once between them.
+*/
+typedef struct graph_search graph_search;
+
+/**
+* Creates a search context over G.
+*
+* Runtime: O(n), once
+* Memory: O(n), twice that after the first bidirectional query
+*
+* @param G the graph to search
+* @return  the search, or NULL if memory allocation failed
+*/
+graph_search* graph_search_create(graph* G);
+
+/**
+* Frees all memory associated with a search.
+*
+* @param self the search being deallocated
+*/
+void graph_search_destroy(graph_search* self);
+
+/**
+* Returns whether the search is a Dijkstra search from start in metric,
+* which a graph_search_to query from start in metric would continue.
+*
+* Runtime: O(1)
+*
+* @param self   the search
+* @param start  a starting vertex
+* @param metric 'D' or 'T'
+* @return       true if the search can be continued for start and metric
+*/
+bool graph_search_from(graph_search* self, vertex_t start, char metric);
+
+/**
+* graph_dijkstras_to on a search context. The search goes on until end is
+* settled; it starts over first unless graph_search_from(self, start, metric).
+*
+* Runtime: O(m + n log n) over all queries from one start; a query whose end
+* is already settled costs O(1)
+*
+* @param self        the search
+* @param start       the starting vertex
+* @param end         the vertex the search is for
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @param parent[out] the parents of the search, as graph_dijkstras_to writes
+*                    them, valid until the next query on self
+* @return            the graph searched, or NULL if end is not a vertex of it
+*                    or memory for the search could not be allocated
+*/
+graph* graph_search_to(graph_search* self, vertex_t start, vertex_t end, char metric, const vertex_t** parent);
+
+/**
+* graph_astar on a search context.
+*
+* @param self        the search
+* @param L           landmarks of the graph built for the same metric
+* @param start       the starting vertex
+* @param end         the vertex the search is for
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @param parent[out] the parents of the search, valid until the next query
+* @return            the graph searched, or NULL as for graph_astar
+*/
+graph* graph_search_astar(graph_search* self, landmarks* L, vertex_t start, vertex_t end, char metric,
+        const vertex_t** parent);
+
+/**
+* graph_bidirectional_dijkstras on a search context.
+*
+* @param self        the search
+* @param R           the edge reversal of the graph
+* @param start       the starting vertex
+* @param end         the vertex the search is for
+* @param metric      'D' to minimize distance or 'T' to minimize time
+* @param parent[out] the spliced parents, valid until the next query
+* @return            the graph searched, or NULL as for
+*                    graph_bidirectional_dijkstras
+*/
+graph* graph_search_bidirectional(graph_search* self, graph* R, vertex_t start, vertex_t end, char metric,
+        const vertex_t** parent);
+
+/**
+* graph_bfs on a search context. The vertices reached are those for which
+* graph_search_reached is true, and only their parents are written.
+*
+* Runtime: O(vertices and edges reached)
+*
+* @param self        the search
+* @param start       the starting vertex
+* @param parent[out] the parents of the reached vertices, start its own,
+*                    valid until the next query
+* @return            the graph searched, or NULL if start is not a vertex of
+*                    it or memory allocation failed
+*/
+graph* graph_search_bfs(graph_search* self, vertex_t start, const vertex_t** parent);
+
+/**
+* Returns whether the last query settled v: reached it, for a breadth first
+* search.
+*
+* Runtime: O(1)
+*
+* @param self the search
+* @param v    a vertex
+* @return     true if v was settled
+*/
+bool graph_search_reached(graph_search* self, vertex_t v);
+
+/**
+* Returns whether the last graph_search_to, graph_search_astar or
+* graph_search_bidirectional query found a path to its end. When it did not,
+* the parents it handed out make start the parent of end.
+*
+* Runtime: O(1)
+*
+* @param self the search
+* @return     true if the end of the last query can be reached from its start
 */
-void graph_dijkstras(graph* G, vertex_t start, vertex_t* parent, double** edge_length);
+bool graph_search_found(graph_search* self);
 
 /**
 * Take the list of parents from disjkstras algorithm and traverse the list given a start and end vertex, resulting in a final list of shortest path.
@@ -53,6 +403,6 @@ void graph_dijkstras(graph* G, vertex_t start, vertex_t* parent, double** edge_l
 * @param path[out] the shortest path
 * @param path_size the size of the shortest path
 */
-void graph_traverse_parents(vertex_t* parent, vertex_t start, vertex_t end,vertex_t* path, int* path_size);
+void graph_traverse_parents(const vertex_t* parent, vertex_t start, vertex_t end,vertex_t* path, int* path_size);
 
 #endif//__GRAPH_LIB_H__
@@ -0,0 +1,107 @@
+// Implementations of the function declarations in landmarks.h.
+#include "landmarks.h"
+#include "graph_lib.h"
+#include <math.h>
+#include <time.h>
+
+// Private helper reading a monotonic clock in seconds.
+static double seconds_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Private helper returning the vertex farthest from every chosen landmark,
+// measured by its nearest one. dist holds distances from vertex 0 before the
+// first landmark is chosen, and distances to the nearest landmark afterwards.
+// Unreachable vertices are never chosen.
+static vertex_t farthest(double* dist, size_t n) {
+    vertex_t best = 0;
+    double best_dist = -1.0;
+    for (vertex_t v = 0; v < n; v++) {
+        if (isfinite(dist[v]) && dist[v] > best_dist) {
+            best = v;
+            best_dist = dist[v];
+        }
+    }
+    return best;
+}
+
+landmarks* landmarks_create(graph* G, graph* R, size_t count, char metric) {
+    double started = seconds_now();
+    size_t n = graph_vertex_count(G);
+    if (count > n) count = n;
+
+    landmarks* self = malloc(sizeof(landmarks));
+    if (self == NULL) { return NULL; }
+    self->count = count;
+    self->n = n;
+    self->metric = metric;
+    self->vertices = malloc(count * sizeof(vertex_t));
+    self->from = malloc(count * n * sizeof(double));
+    self->to = malloc(count * n * sizeof(double));
+    double* dist = malloc(n * sizeof(double));
+    double* nearest = malloc(n * sizeof(double));
+    bool ok = self->vertices != NULL && self->from != NULL && self->to != NULL
+        && dist != NULL && nearest != NULL;
+
+    if (ok && n > 0) {
+        ok = graph_dijkstras_distances(G, 0, nearest, metric) != NULL;
+    }
+    for (size_t l = 0; ok && l < count; l++) {
+        vertex_t L = farthest(nearest, n);
+        self->vertices[l] = L;
+
+        // d(L, v) on the map and d(v, L) on the reversed map
+        ok = graph_dijkstras_distances(G, L, dist, metric) != NULL;
+        for (vertex_t v = 0; ok && v < n; v++) {
+            self->from[v * count + l] = dist[v];
+            if (l == 0 || dist[v] < nearest[v]) nearest[v] = dist[v];
+        }
+        nearest[L] = 0.0;
+        ok = ok && graph_dijkstras_distances(R, L, dist, metric) != NULL;
+        for (vertex_t v = 0; ok && v < n; v++) {
+            self->to[v * count + l] = dist[v];
+        }
+    }
+    free(dist);
+    free(nearest);
+
+    if (!ok) {
+        landmarks_destroy(self);
+        return NULL;
+    }
+    self->preprocessing_seconds = seconds_now() - started;
+    return self;
+}
+
+void landmarks_destroy(landmarks* self) {
+    free(self->vertices);
+    free(self->from);
+    free(self->to);
+    free(self);
+}
+
+double landmarks_bound(landmarks* self, vertex_t v, vertex_t t) {
+    const double* from_v = self->from + v * self->count;
+    const double* from_t = self->from + t * self->count;
+    const double* to_v = self->to + v * self->count;
+    const double* to_t = self->to + t * self->count;
+
+    // Terms with an unreachable distance say nothing and are skipped
+    double bound = 0.0;
+    for (size_t l = 0; l < self->count; l++) {
+        if (isfinite(from_t[l]) && isfinite(from_v[l]) && from_t[l] - from_v[l] > bound) {
+            bound = from_t[l] - from_v[l];
+        }
+        if (isfinite(to_v[l]) && isfinite(to_t[l]) && to_v[l] - to_t[l] > bound) {
+            bound = to_v[l] - to_t[l];
+        }
+    }
+    return bound;
+}
+
+size_t landmarks_memory(landmarks* self) {
+    return sizeof(landmarks) + self->count * sizeof(vertex_t)
+        + 2 * self->count * self->n * sizeof(double);
+}
@@ -0,0 +1,76 @@
+/**
+ * This header provides landmark (ALT) lower bounds for A* search.
+ *
+ * For a landmark L the triangle inequality gives, for any vertices v and t,
+ *     d(v,t) >= d(L,t) - d(L,v)   and   d(v,t) >= d(v,L) - d(t,L),
+ * so the largest of these over a set of landmarks is an admissible and
+ * consistent estimate of the remaining distance to t. The distances to and
+ * from every landmark are computed once per map and metric.
+ */
+#ifndef __LANDMARKS_H__
+#define __LANDMARKS_H__
+
+#include "graph.h"
+
+/**
+ * Struct holding the landmark tables of one map and metric.
+ */
+typedef struct landmarks
+{
+    size_t count;                  // number of landmarks
+    size_t n;                      // number of vertices in the map
+    char metric;                   // 'D' or 'T'
+    vertex_t* vertices;            // the landmarks, in the order chosen
+    double* from;                  // from[v*count + l] = d(landmark l, v)
+    double* to;                    // to[v*count + l] = d(v, landmark l)
+    double preprocessing_seconds;  // time spent choosing and measuring
+} landmarks;
+
+/**
+ * Chooses landmarks and computes their distance tables.
+ *
+ * Landmarks are chosen by farthest point selection: the first is the vertex
+ * farthest from vertex 0, and each later one is the vertex whose distance to
+ * the nearest chosen landmark is largest, which spreads them towards the
+ * edges of the map. Each landmark costs one full graph_dijkstras search on G
+ * and one on R.
+ *
+ * Runtime: O(count (m + n log n))
+ * Memory: 2 * count * n doubles
+ *
+ * @param  G      the map
+ * @param  R      the edge reversal of G
+ * @param  count  the number of landmarks wanted (at most n are used)
+ * @param  metric 'D' for distance or 'T' for time
+ * @return        the landmark tables, or NULL if memory allocation failed
+ */
+landmarks* landmarks_create(graph* G, graph* R, size_t count, char metric);
+
+/**
+ * Frees all memory associated with a set of landmarks.
+ *
+ * @param self the landmarks being deallocated
+ */
+void landmarks_destroy(landmarks* self);
+
+/**
+ * Returns a lower bound on the distance from v to t.
+ *
+ * Runtime: O(count)
+ *
+ * @param  self the landmarks
+ * @param  v    the vertex the estimate is from
+ * @param  t    the target vertex
+ * @return      a lower bound on d(v,t), which is 0 when nothing is known
+ */
+double landmarks_bound(landmarks* self, vertex_t v, vertex_t t);
+
+/**
+ * Returns the number of bytes used by the landmark tables.
+ *
+ * @param  self the landmarks
+ * @return      the memory footprint in bytes
+ */
+size_t landmarks_memory(landmarks* self);
+
+#endif//__LANDMARKS_H__
@@ -6,9 +6,16 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "batch.h"
 #include "graph_lib.h"
 #include "graph.h"
+#include "ch.h"
+#include "mapfile.h"
 #include "parser.h"
+#include "route_cache.h"
 
 static void time_format(double speed, double distance, char* output){
     double hour = 0;
@@ -37,128 +44,652 @@ static void time_format(double speed, double distance, char* output){
     }
 }
 
-// Here is an example of how you will be working with the output of the parser.
-int main() {
-    FILE* file = fopen("data/sample.txt", "r");
+// The shortest path searches a trip can be answered with.
+typedef enum search_kind {
+    SEARCH_DIJKSTRA,
+    SEARCH_BIDIRECTIONAL,
+    SEARCH_ASTAR,
+    SEARCH_CH
+} search_kind;
+
+static void usage(const char* program){
+    fprintf(stderr, "usage: %s [-q heap|radix] [-a dijkstra|bidirectional|astar|ch] [-l landmarks] [-j threads] [-c cache_mib] [-t] [input file]\n", program);
+    fprintf(stderr, "       %s -w map_file [-l landmarks] [-j threads] [input file]\n", program);
+    fprintf(stderr, "       %s -m map_file [-q ...] [-a ...] [-j threads] [-c cache_mib] [-t] [trip file]\n", program);
+}
+
+// Name of a location, from the map file when there is one.
+static const char* location_name(file_record* fr, map_file* mf, vertex_t v){
+    return mf != NULL ? map_file_name(mf, v) : fr->locations[v].name;
+}
+
+// Reports an input error found by the parser; returns true if there was one.
+static bool input_error(const char* input, file_record* fr){
+    if (fr->error == NULL){
+        return false;
+    }
+    fprintf(stderr, "%s:%zu: %s\n", input, fr->error_line, fr->error);
+    return true;
+}
+
+// Converts a text input to a map file with the reversed map and landmark
+// tables for both metrics, so that later runs start without preprocessing.
+static int convert(const char* input, const char* output, size_t landmark_count){
+    FILE* file = fopen(input, "r");
+    if (file == NULL){
+        perror(input);
+        return EXIT_FAILURE;
+    }
     file_record fr = parse_file(file);
     fclose(file);
+    if (input_error(input, &fr)){
+        file_record_destroy(fr);
+        return EXIT_FAILURE;
+    }
 
-    //create the graph using the data
-    graph* map = graph_create(fr.location_count, true);
-    for (size_t i = 0; i < fr.road_count; i++) {
-        // add of the edges to the graph
-        graph_add_edge(map, fr.roads[i].start, fr.roads[i].end);
-    }
-    // if map is disconnected, print statement and end program
-    if (!graph_is_connected(map)){
-        printf("Disconnected Map");
-        return EXIT_SUCCESS;
-    }
-
-    for (size_t i = 0; i<fr.trip_count; i++){
-        if (fr.trips[i].type == 'D'){
-            // create the edge length matrix
-            double **edge_length = (double**)malloc(sizeof (double*) * fr.location_count);
-            if (edge_length)
-            {
-                for (int i = 0; i < (int)fr.location_count; i++)
-                {
-                    edge_length[i] = (double*)malloc(sizeof (double) * fr.location_count);
-                }
+    graph* map = graph_create_from_roads(fr.location_count, fr.roads, fr.road_count, true);
+    graph* reversed = map != NULL ? graph_edge_reversal(map) : NULL;
+    landmarks* distance_landmarks = reversed != NULL ? landmarks_create(map, reversed, landmark_count, 'D') : NULL;
+    landmarks* time_landmarks = reversed != NULL ? landmarks_create(map, reversed, landmark_count, 'T') : NULL;
+    int status = EXIT_SUCCESS;
+    if (distance_landmarks == NULL || time_landmarks == NULL){
+        fprintf(stderr, "Out of memory\n");
+        status = EXIT_FAILURE;
+    } else if (!map_file_write(output, map, &fr, reversed, distance_landmarks, time_landmarks)){
+        perror(output);
+        status = EXIT_FAILURE;
+    } else {
+        fprintf(stderr, "Wrote %s: %zu locations, %zu roads, %zu landmarks per metric\n",
+                output, graph_vertex_count(map), graph_edge_count(map), distance_landmarks->count);
+    }
+
+    if (distance_landmarks != NULL){
+        landmarks_destroy(distance_landmarks);
+    }
+    if (time_landmarks != NULL){
+        landmarks_destroy(time_landmarks);
+    }
+    if (reversed != NULL){
+        graph_destroy(reversed);
+    }
+    if (map != NULL){
+        graph_destroy(map);
+    }
+    file_record_destroy(fr);
+    return status;
+}
+
+// Whether every location reaches location 0 and is reached from it, found by
+// a parallel breadth first search on the map and on its reversal.
+static bool reaches_all(graph* map, graph* reversed, size_t threads){
+    size_t n = graph_vertex_count(map);
+    vertex_t* parent = malloc((n + 1) * sizeof(vertex_t));
+    bool connected = parent != NULL && n > 0;
+    for (int side = 0; connected && side < 2; side++){
+        graph* G = side == 0 ? map : reversed;
+        graph* R = side == 0 ? reversed : map;
+        connected = graph_bfs_parallel(G, R, 0, parent, threads) != NULL;
+        for (vertex_t v = 1; connected && v < n; v++){
+            connected = parent[v] != v;
+        }
+    }
+    free(parent);
+    return connected;
+}
+
+// The map and its preprocessing, shared by every thread answering trips.
+// Landmarks and hierarchies are only ever set by the reading thread, before
+// the first trip that needs them is handed to a worker.
+typedef struct trip_context {
+    graph* map;
+    graph* reversed;
+    file_record* fr;
+    map_file* mf;
+    search_kind search;
+    size_t landmark_count;
+    landmarks* distance_landmarks;
+    landmarks* time_landmarks;
+    ch* distance_hierarchy;
+    ch* time_hierarchy;
+    route_cache* cache;
+    const vertex_t* component;
+} trip_context;
+
+// Search workspace of one worker, reused for every trip it answers, so a
+// trip costs time in proportion to the vertices its search visits and does
+// not allocate. Dijkstra keeps its last search, which the next trip from the
+// same start continues. The state and its arrays live in one arena.
+typedef struct trip_state {
+    arena* memory;
+    graph_search* search;
+    ch_search* hierarchy_search;
+    vertex_t* parent;
+    vertex_t* path;
+} trip_state;
+
+// Builds the landmarks or hierarchy a trip of the given type is answered
+// with, the first time one needs them; returns false if out of memory.
+static bool prepare(trip_context* ctx, char type){
+    if (ctx->search == SEARCH_ASTAR){
+        landmarks** table = type == 'D' ? &ctx->distance_landmarks : &ctx->time_landmarks;
+        if (*table == NULL){
+            *table = landmarks_create(ctx->map, ctx->reversed, ctx->landmark_count, type);
+            if (*table == NULL){
+                return false;
             }
-            for (int i = 0; i < (int)fr.road_count; i++){
-                // fill matrix with road distances
-                edge_length[(int)fr.roads[i].start][(int)fr.roads[i].end] = (double)fr.roads[i].distance;
+            fprintf(stderr, "ALT %s landmarks:", type == 'D' ? "distance" : "time");
+            for (size_t l = 0; l < (*table)->count; l++){
+                fprintf(stderr, " %lu", (*table)->vertices[l]);
             }
+            fprintf(stderr, " (farthest point selection, %.3f s, %.1f KiB)\n",
+                    (*table)->preprocessing_seconds, landmarks_memory(*table) / 1024.0);
+        }
+    } else if (ctx->search == SEARCH_CH){
+        ch** hierarchy = type == 'D' ? &ctx->distance_hierarchy : &ctx->time_hierarchy;
+        if (*hierarchy == NULL){
+            *hierarchy = ch_create(ctx->map, type);
+            if (*hierarchy == NULL){
+                return false;
+            }
+            fprintf(stderr, "CH %s hierarchy: %zu edges + %zu shortcuts (%.3f s, %.1f KiB)\n",
+                    type == 'D' ? "distance" : "time", (*hierarchy)->edge_count,
+                    (*hierarchy)->shortcut_count, (*hierarchy)->preprocessing_seconds,
+                    ch_memory(*hierarchy) / 1024.0);
+        }
+    }
+    return true;
+}
 
-            vertex_t parent[fr.location_count];
-            graph_dijkstras(map, fr.trips[i].start, parent, edge_length);
+static void trip_state_destroy(void* context, void* state);
 
-            vertex_t path[fr.location_count];
-            int path_size = 0;
-            graph_traverse_parents(parent, fr.trips[i].start, fr.trips[i].end, path, &path_size);
+static void* trip_state_create(void* context){
+    trip_context* ctx = context;
+    size_t n = graph_vertex_count(ctx->map);
+    arena* memory = arena_create();
+    trip_state* state = memory != NULL ? arena_calloc(memory, 1, sizeof(trip_state)) : NULL;
+    if (state == NULL){
+        arena_destroy(memory);
+        return NULL;
+    }
+    state->memory = memory;
+    if (ctx->search == SEARCH_CH){
+        state->hierarchy_search = ch_search_create(n);
+        state->parent = arena_alloc(memory, (n + 1) * sizeof(vertex_t));
+    } else {
+        state->search = graph_search_create(ctx->map);
+    }
+    state->path = arena_alloc(memory, (n + 1) * sizeof(vertex_t));
+    if ((state->search == NULL && (state->hierarchy_search == NULL || state->parent == NULL))
+            || state->path == NULL){
+        trip_state_destroy(context, state);
+        return NULL;
+    }
+    return state;
+}
 
-            printf("Shortest distance from %s to %s\n", fr.locations[fr.trips[i].start].name, fr.locations[fr.trips[i].end].name);
-            printf("    Begin at %s\n", fr.locations[path[0]].name);
-            double total_distance = 0.0;
-            for (int j = 1; j < path_size; j++){
-                total_distance += edge_length[path[j-1]][path[j]];
-                printf("    Continue to %s (%.1f miles)\n", fr.locations[path[j]].name, edge_length[path[j-1]][path[j]]);
-            }
-            printf("Total distance: %.1f miles\n\n", total_distance);
+static void trip_state_destroy(void* context, void* state){
+    (void)context;
+    trip_state* self = state;
+    if (self->search != NULL){
+        graph_search_destroy(self->search);
+    }
+    if (self->hierarchy_search != NULL){
+        ch_search_destroy(self->hierarchy_search);
+    }
+    arena_destroy(self->memory);
+}
+
+// Whether a worker's kept search already starts where trip does.
+static bool trip_prefer(void* context, void* state, const trip_record* trip){
+    (void)context;
+    trip_state* self = state;
+    return graph_search_from(self->search, trip->start, trip->type);
+}
+
+// Finds the shortest path of a trip with a worker's search state, setting
+// found to whether there is one; returns false if out of memory.
+static bool trip_search(trip_context* ctx, trip_state* self, const trip_record* trip, size_t* path_size, bool* found){
+    graph* map = ctx->map;
+    const vertex_t* parent = self->parent;
+    graph* searched = NULL;
+    if (ctx->search == SEARCH_BIDIRECTIONAL){
+        searched = graph_search_bidirectional(self->search, ctx->reversed, trip->start, trip->end, trip->type, &parent);
+    } else if (ctx->search == SEARCH_ASTAR){
+        landmarks* table = trip->type == 'D' ? ctx->distance_landmarks : ctx->time_landmarks;
+        searched = graph_search_astar(self->search, table, trip->start, trip->end, trip->type, &parent);
+    } else if (ctx->search == SEARCH_CH){
+        ch* hierarchy = trip->type == 'D' ? ctx->distance_hierarchy : ctx->time_hierarchy;
+        double cost = 0.0;
+        searched = ch_search_query(self->hierarchy_search, hierarchy, trip->start, trip->end, self->parent, &cost) != NULL
+            ? map : NULL;
+        *found = cost != INFINITY;
+    } else {
+        searched = graph_search_to(self->search, trip->start, trip->end, trip->type, &parent);
+    }
+    if (searched == NULL){
+        return false;
+    }
+
+    if (ctx->search != SEARCH_CH){
+        *found = graph_search_found(self->search);
+    }
+    if (!*found){
+        return true;
+    }
+    int size = 0;
+    graph_traverse_parents(parent, trip->start, trip->end, self->path, &size);
+    *path_size = (size_t)size;
+    return true;
+}
+
+// Answers one trip: finds its shortest path, or takes it from the route
+// cache, and writes the directions.
+static bool trip_answer(void* context, void* state, const trip_record* trip, batch_text* out){
+    trip_context* ctx = context;
+    trip_state* self = state;
+    graph* map = ctx->map;
+    file_record* fr = ctx->fr;
+    map_file* mf = ctx->mf;
+    vertex_t* path = self->path;
+
+    // components are labelled in reverse topological order, so a trip to a
+    // later one has no route; one to an earlier one is left to the search,
+    // which reports whether it found one
+    size_t path_size = 0;
+    double total_distance = 0.0;
+    double total_time = 0.0;
+    bool found = ctx->component[trip->start] >= ctx->component[trip->end];
+    if (found && (ctx->cache == NULL || !route_cache_get(ctx->cache, trip->start, trip->end, trip->type,
+            path, &path_size, &total_distance, &total_time))){
+        if (!trip_search(ctx, self, trip, &path_size, &found)){
+            return false;
+        }
+        for (size_t j = 1; found && j < path_size; j++){
+            double length = 0.0;
+            double speed = 0.0;
+            graph_edge_weights(map, path[j-1], path[j], &length, &speed);
+            total_distance += length;
+            total_time += length/speed;
+        }
+        // a route that is not cached is only computed again
+        if (found && ctx->cache != NULL){
+            route_cache_put(ctx->cache, trip->start, trip->end, trip->type,
+                    path, path_size, total_distance, total_time);
+        }
+    }
+
+    if (!found){
+        return batch_printf(out, "No route from %s to %s\n\n", location_name(fr, mf, trip->start),
+                location_name(fr, mf, trip->end));
+    }
+
+    bool ok = batch_printf(out, "Shortest distance from %s to %s\n", location_name(fr, mf, trip->start),
+            location_name(fr, mf, trip->end));
+    ok = ok && batch_printf(out, "    Begin at %s\n", location_name(fr, mf, path[0]));
+    if (trip->type == 'D'){
+        for (size_t j = 1; ok && j < path_size; j++){
+            // read the length of the road being traversed
+            double length = 0.0;
+            graph_edge_weights(map, path[j-1], path[j], &length, NULL);
+            ok = batch_printf(out, "    Continue to %s (%.1f miles)\n", location_name(fr, mf, path[j]), length);
+        }
+        ok = ok && batch_printf(out, "Total distance: %.1f miles\n\n", total_distance);
 
+    } else {
+        char time_output[100];
+        for (size_t j = 1; ok && j < path_size; j++){
+            // read the length and speed of the road being traversed
+            double length = 0.0;
+            double speed = 0.0;
+            graph_edge_weights(map, path[j-1], path[j], &length, &speed);
+            time_format(speed, length, time_output);
+            ok = batch_printf(out, "    Continue to %s (%.1f miles @ %.1f mph = %s)\n", location_name(fr, mf, path[j]),
+            length, speed, time_output);
+        }
+        // the total is formatted as it always was, from minutes
+        time_format(total_time*60, total_distance, time_output);
+        ok = ok && batch_printf(out, "Total time: %s \n\n", time_output);
+    }
+    return ok;
+}
 
-            for(int k=0;k<(int)fr.location_count;k++){
-                free(edge_length[k]);
+// Answers the trips as origin x destination tables instead of routes. For each
+// metric the distinct starts of its trips are the origins and their distinct
+// ends the destinations; every pair gets its cost, in miles or minutes, or -
+// when there is no route. Returns false if out of memory.
+static bool answer_tables(trip_context* ctx, trip_reader* reader, size_t threads){
+    size_t n = graph_vertex_count(ctx->map);
+    size_t capacity = 64;
+    size_t count = 0;
+    trip_record* trips = malloc(capacity * sizeof(trip_record));
+    size_t* slot = malloc((n + 1) * sizeof(size_t));
+    vertex_t* sources = malloc((n + 1) * sizeof(vertex_t));
+    vertex_t* targets = malloc((n + 1) * sizeof(vertex_t));
+    bool ok = trips != NULL && slot != NULL && sources != NULL && targets != NULL;
+    trip_record trip;
+    while (ok && trip_reader_next(reader, &trip)){
+        if (count == capacity){
+            capacity *= 2;
+            trip_record* grown = realloc(trips, capacity * sizeof(trip_record));
+            ok = grown != NULL;
+            if (ok){
+                trips = grown;
             }
-            free(edge_length);
+        }
+        if (ok){
+            trips[count++] = trip;
+        }
+    }
 
-        } else {
-            // create edge length matrix
-            double **edge_length = (double**)malloc(sizeof (double*) * fr.location_count);
-            if (edge_length)
-            {
-                for (int i = 0; i < (int)fr.location_count; i++)
-                {
-                    edge_length[i] = (double*)malloc(sizeof (double) * fr.location_count);
-                }
+    for (const char* metric = "DT"; ok && *metric != '\0'; metric++){
+        // number the distinct origins, then the distinct destinations
+        size_t source_count = 0;
+        size_t target_count = 0;
+        for (size_t v = 0; v < n; v++){
+            slot[v] = SIZE_MAX;
+        }
+        for (size_t i = 0; i < count; i++){
+            if (trips[i].type == *metric && slot[trips[i].start] == SIZE_MAX){
+                slot[trips[i].start] = source_count;
+                sources[source_count++] = trips[i].start;
             }
-            for (int i = 0; i < (int)fr.road_count; i++){
-                // fill matrix with road distances
-                edge_length[(int)fr.roads[i].start][(int)fr.roads[i].end] = (double)fr.roads[i].distance;
+        }
+        for (size_t v = 0; v < n; v++){
+            slot[v] = SIZE_MAX;
+        }
+        for (size_t i = 0; i < count; i++){
+            if (trips[i].type == *metric && slot[trips[i].end] == SIZE_MAX){
+                slot[trips[i].end] = target_count;
+                targets[target_count++] = trips[i].end;
             }
+        }
+        if (source_count == 0){
+            continue;
+        }
 
-            //create edge speed matrix
-            double **edge_speed = (double**)malloc(sizeof (double*) * fr.location_count);
-            if (edge_speed)
-            {
-                for (int i = 0; i < (int)fr.location_count; i++)
-                {
-                    edge_speed[i] = (double*)malloc(sizeof (double) * fr.location_count);
-                }
+        double* table = target_count <= SIZE_MAX / sizeof(double) / source_count
+            ? malloc(source_count * target_count * sizeof(double)) : NULL;
+        ch** hierarchy = *metric == 'D' ? &ctx->distance_hierarchy : &ctx->time_hierarchy;
+        ok = table != NULL && prepare(ctx, *metric)
+            && graph_distance_table(ctx->map, sources, source_count, targets, target_count, *metric,
+                    table, threads, hierarchy) != NULL;
+
+        if (ok){
+            printf("%s table (%s): %zu origins x %zu destinations\n", *metric == 'D' ? "Distance" : "Time",
+                    *metric == 'D' ? "miles" : "minutes", source_count, target_count);
+            printf("From\\To");
+            for (size_t j = 0; j < target_count; j++){
+                printf("\t%s", location_name(ctx->fr, ctx->mf, targets[j]));
             }
-            for (int i = 0; i < (int)fr.road_count; i++){
-                // fill matrix with road speeds
-                edge_speed[(int)fr.roads[i].start][(int)fr.roads[i].end] = (double)fr.roads[i].speed;
+            printf("\n");
+        }
+        for (size_t i = 0; ok && i < source_count; i++){
+            printf("%s", location_name(ctx->fr, ctx->mf, sources[i]));
+            for (size_t j = 0; j < target_count; j++){
+                // the hierarchy's time metric is in hours
+                double cost = table[i * target_count + j];
+                if (cost == INFINITY){
+                    printf("\t-");
+                } else {
+                    printf("\t%.1f", *metric == 'D' ? cost : cost * 60);
+                }
             }
+            printf("\n");
+        }
+        if (ok){
+            printf("\n");
+        }
+        free(table);
+    }
+
+    free(trips);
+    free(slot);
+    free(sources);
+    free(targets);
+    return ok;
+}
 
-            vertex_t parent[fr.location_count];
-            graph_dijkstras(map, fr.trips[i].start, parent, edge_length);
-
-            vertex_t path[fr.location_count];
-            int path_size = 0;
-            graph_traverse_parents(parent, fr.trips[i].start, fr.trips[i].end, path, &path_size);
-
-            printf("Shortest distance from %s to %s\n", fr.locations[fr.trips[i].start].name, fr.locations[fr.trips[i].end].name);
-            printf("    Begin at %s\n", fr.locations[path[0]].name);
-            double total_time = 0.0;
-            double total_distance = 0.0;
-            char time_output[100];
-            for (int j = 1; j < path_size; j++){
-                total_time += edge_length[path[j-1]][path[j]]/edge_speed[path[j-1]][path[j]]*60;
-                total_distance += edge_length[path[j-1]][path[j]];
-                time_format(edge_speed[path[j-1]][path[j]], edge_length[path[j-1]][path[j]], time_output);
-                printf("    Continue to %s (%.1f miles @ %.1f mph = %s)\n", fr.locations[path[j]].name,
-                edge_length[path[j-1]][path[j]], edge_speed[path[j-1]][path[j]], time_output);
+// Here is an example of how you will be working with the output of the parser.
+int main(int argc, char** argv) {
+    const char* input = NULL;
+    const char* map_path = NULL;
+    const char* write_path = NULL;
+    search_kind search = SEARCH_DIJKSTRA;
+    size_t landmark_count = 8;
+    size_t threads = 0;
+    size_t cache_mib = 64;
+    bool tables = false;
+    for (int a = 1; a < argc; a++){
+        if (strcmp(argv[a], "-q") == 0 && a + 1 < argc){
+            // choose the priority queue for the searches
+            a++;
+            if (strcmp(argv[a], "heap") == 0){
+                graph_set_queue(GRAPH_QUEUE_HEAP);
+            } else if (strcmp(argv[a], "radix") == 0){
+                graph_set_queue(GRAPH_QUEUE_RADIX);
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
             }
-            time_format(total_time, total_distance, time_output);
-            printf("Total time: %s \n\n", time_output);
+        } else if (strcmp(argv[a], "-a") == 0 && a + 1 < argc){
+            // choose the shortest path search
+            a++;
+            if (strcmp(argv[a], "dijkstra") == 0){
+                search = SEARCH_DIJKSTRA;
+            } else if (strcmp(argv[a], "bidirectional") == 0){
+                search = SEARCH_BIDIRECTIONAL;
+            } else if (strcmp(argv[a], "astar") == 0){
+                search = SEARCH_ASTAR;
+            } else if (strcmp(argv[a], "ch") == 0){
+                search = SEARCH_CH;
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[a], "-l") == 0 && a + 1 < argc){
+            // number of landmarks for A*
+            a++;
+            landmark_count = strtoul(argv[a], NULL, 10);
+            if (landmark_count == 0){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[a], "-j") == 0 && a + 1 < argc){
+            // threads parsing the road section and answering trips, 0 for
+            // one per core
+            a++;
+            char* end = NULL;
+            threads = strtoul(argv[a], &end, 10);
+            if (end == argv[a] || *end != '\0'){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            parse_set_threads(threads);
+        } else if (strcmp(argv[a], "-c") == 0 && a + 1 < argc){
+            // memory for the route cache in MiB, 0 to turn it off
+            a++;
+            char* end = NULL;
+            cache_mib = strtoul(argv[a], &end, 10);
+            if (end == argv[a] || *end != '\0'){
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[a], "-t") == 0){
+            // answer the trips as origin x destination tables
+            tables = true;
+            search = SEARCH_CH;
+        } else if (strcmp(argv[a], "-m") == 0 && a + 1 < argc){
+            // load a map file instead of parsing text
+            map_path = argv[++a];
+        } else if (strcmp(argv[a], "-w") == 0 && a + 1 < argc){
+            // convert the input to a map file
+            write_path = argv[++a];
+        } else if (argv[a][0] != '-'){
+            input = argv[a];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
+    if (write_path != NULL){
+        if (map_path != NULL){
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return convert(input != NULL ? input : "data/sample.txt", write_path, landmark_count);
+    }
 
-            for(int k=0;k<(int)fr.location_count;k++){
-                free(edge_length[k]);
-                free(edge_speed[k]);
-            }
-            free(edge_length);
-            free(edge_speed);
+    // The map comes from a map file, or from the location and road sections
+    // of a text input. Trips are then read one at a time, from the trip file
+    // or stdin after a map file and from the rest of a text input, and
+    // answered by a pool of threads while the next ones are read.
+    map_file* mf = NULL;
+    file_record fr = { 0 };
+    FILE* file = stdin;
+    if (map_path != NULL){
+        mf = map_file_open(map_path);
+        if (mf == NULL){
+            perror(map_path);
+            return EXIT_FAILURE;
+        }
+    } else if (input == NULL){
+        input = "data/sample.txt";
+    }
+    if (input != NULL){
+        file = fopen(input, "r");
+        if (file == NULL){
+            perror(input);
+            return EXIT_FAILURE;
+        }
+    }
+    const char* trip_source = input != NULL ? input : "stdin";
+    if (mf == NULL){
+        fr = parse_map(file);
+        if (input_error(input, &fr)){
+            file_record_destroy(fr);
+            fclose(file);
+            return EXIT_FAILURE;
         }
     }
 
+    //create the graph using the data; when memory runs out before the trips
+    // are answered, ready is cleared and the teardown below is all that runs
+    graph* map = mf != NULL ? mf->map : graph_create_from_roads(fr.location_count, fr.roads, fr.road_count, true);
+    bool ready = map != NULL;
+    size_t location_count = ready ? graph_vertex_count(map) : 0;
+
+    // the backward search walks the reversed map, built once for all trips
+    graph* reversed = mf != NULL ? mf->reversed : NULL;
+    if (ready && (search == SEARCH_BIDIRECTIONAL || search == SEARCH_ASTAR) && reversed == NULL){
+        reversed = graph_edge_reversal(map);
+        ready = reversed != NULL;
+    }
+
+    // trips are answered within each part of a disconnected map, and those
+    // between parts with no route are told so; with the reversed map at hand
+    // a connected map is recognised without labelling the parts
+    vertex_t* component = NULL;
+    size_t component_count = 1;
+    if (ready){
+        component = calloc(location_count + 1, sizeof(vertex_t));
+        ready = component != NULL && ((reversed != NULL && reaches_all(map, reversed, threads))
+                || graph_strong_components(map, component, &component_count) != NULL);
+    }
+    if (ready && component_count > 1){
+        fprintf(stderr, "Disconnected map: %zu strongly connected components\n", component_count);
+    }
+
+    // A* landmarks and contraction hierarchies are built the first time a
+    // trip uses their metric, then kept for the trips after it
+    trip_context ctx = { map, reversed, &fr, mf, search, landmark_count,
+        mf != NULL ? mf->distance_landmarks : NULL, mf != NULL ? mf->time_landmarks : NULL, NULL, NULL, NULL, component };
+
+    // popular trips are answered from the routes already computed; the
+    // cache drops them if the map changes
+    if (ready && cache_mib > 0 && !tables){
+        ctx.cache = route_cache_create(map, cache_mib << 20);
+    }
+    bool answered = ready && (cache_mib == 0 || tables || ctx.cache != NULL);
+
+    // answers to trips arriving over a pipe or terminal go out one by one;
+    // a trip file is all there already, so buffered output is left to fill
+    struct stat trip_info;
+    bool flush_each = fstat(fileno(file), &trip_info) != 0 || !S_ISREG(trip_info.st_mode);
 
-    graph_destroy(map);
+    // Dijkstra trips from one start are grouped onto the worker keeping
+    // that search
+    batch_task task = { trip_state_create, trip_answer, trip_state_destroy,
+        search == SEARCH_DIJKSTRA ? trip_prefer : NULL, &ctx };
+    batch* engine = answered && !tables ? batch_create(&task, threads, stdout, flush_each) : NULL;
+    answered = answered && (tables || engine != NULL);
+
+    trip_reader reader;
+    trip_reader_init(&reader, file, location_count, fr.lines_read);
+    trip_record trip;
+    if (tables){
+        answered = answered && answer_tables(&ctx, &reader, threads);
+    }
+    while (answered && engine != NULL && trip_reader_next(&reader, &trip)){
+        answered = prepare(&ctx, trip.type) && batch_submit(engine, &trip);
+    }
+    if (engine != NULL){
+        answered = batch_finish(engine) && answered;
+        // how evenly the trips spread over the workers
+        for (size_t w = 0; batch_threads(engine) > 1 && w < batch_threads(engine); w++){
+            batch_worker_stats stats = batch_stats(engine, w);
+            fprintf(stderr, "Worker %zu: %zu trips (%zu stolen), busy %.3f of %.3f s (%.1f%%)\n",
+                    w, stats.trips, stats.stolen, stats.busy_seconds, batch_seconds(engine),
+                    100.0 * stats.utilization);
+        }
+        batch_destroy(engine);
+    }
+    if (ctx.cache != NULL){
+        route_cache_usage usage = route_cache_stats(ctx.cache);
+        size_t lookups = usage.hits + usage.misses;
+        fprintf(stderr, "Route cache: %zu hits of %zu lookups (%.1f%%), %zu routes, %zu evicted, %.1f of %.1f KiB\n",
+                usage.hits, lookups, lookups > 0 ? 100.0 * usage.hits / lookups : 0.0, usage.routes,
+                usage.evictions, usage.bytes / 1024.0, usage.capacity / 1024.0);
+        route_cache_destroy(ctx.cache);
+    }
+    int status = EXIT_SUCCESS;
+    if (!answered){
+        fprintf(stderr, "Out of memory\n");
+        status = EXIT_FAILURE;
+    } else if (reader.error != NULL){
+        fprintf(stderr, "%s:%zu: %s\n", trip_source, reader.error_line, reader.error);
+        status = EXIT_FAILURE;
+    }
+    trip_reader_destroy(&reader);
+    if (file != stdin){
+        fclose(file);
+    }
+
+    if (ctx.distance_hierarchy != NULL){
+        ch_destroy(ctx.distance_hierarchy);
+    }
+    if (ctx.time_hierarchy != NULL){
+        ch_destroy(ctx.time_hierarchy);
+    }
+    // whatever came from the map file is released with it
+    if (ctx.distance_landmarks != NULL && (mf == NULL || ctx.distance_landmarks != mf->distance_landmarks)){
+        landmarks_destroy(ctx.distance_landmarks);
+    }
+    if (ctx.time_landmarks != NULL && (mf == NULL || ctx.time_landmarks != mf->time_landmarks)){
+        landmarks_destroy(ctx.time_landmarks);
+    }
+    if (reversed != NULL && (mf == NULL || reversed != mf->reversed)){
+        graph_destroy(reversed);
+    }
+    if (mf != NULL){
+        map_file_close(mf);
+    } else if (map != NULL){
+        graph_destroy(map);
+    }
     file_record_destroy(fr);
+    free(component);
 
-    return EXIT_SUCCESS;
+    return status;
 }
 
 /*
@@ -0,0 +1,293 @@
+// Implementations of the function declarations in mapfile.h.
+#include "mapfile.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAP_FILE_MAGIC "DDMAP\r\n\032"
+#define MAP_FILE_BYTE_ORDER 0x01020304u
+#define MAP_FILE_ALIGNMENT 64
+
+// The sections of a map file, in the order they are written.
+typedef enum map_section {
+    SECTION_OFFSET,
+    SECTION_TARGET,
+    SECTION_DISTANCE,
+    SECTION_SPEED,
+    SECTION_NAME_OFFSET,
+    SECTION_NAMES,
+    SECTION_REVERSED_OFFSET,
+    SECTION_REVERSED_TARGET,
+    SECTION_REVERSED_DISTANCE,
+    SECTION_REVERSED_SPEED,
+    SECTION_DISTANCE_LANDMARKS,
+    SECTION_DISTANCE_FROM,
+    SECTION_DISTANCE_TO,
+    SECTION_TIME_LANDMARKS,
+    SECTION_TIME_FROM,
+    SECTION_TIME_TO,
+    SECTION_COUNT
+} map_section;
+
+// The header at the start of a map file. Absent sections have length 0.
+typedef struct map_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;            // MAP_FILE_BYTE_ORDER as written
+    uint32_t header_size;
+    uint32_t size_size;             // sizeof(size_t)
+    uint32_t vertex_size;           // sizeof(vertex_t)
+    uint32_t double_size;           // sizeof(double)
+    uint64_t n;
+    uint64_t m;
+    uint64_t directed;
+    uint64_t reversed_m;
+    uint64_t distance_landmark_count;
+    uint64_t time_landmark_count;
+    uint64_t names_size;
+    uint64_t section[SECTION_COUNT][2]; // byte offset and length
+} map_header;
+
+// Private helper that describes a landmark table's sections.
+static void landmark_sections(landmarks* L, const void** data, uint64_t* length, map_section first) {
+    if (L == NULL) { return; }
+    data[first] = L->vertices;
+    length[first] = L->count * sizeof(vertex_t);
+    data[first + 1] = L->from;
+    length[first + 1] = L->count * L->n * sizeof(double);
+    data[first + 2] = L->to;
+    length[first + 2] = L->count * L->n * sizeof(double);
+}
+
+bool map_file_write(const char* path, graph* G, file_record* fr, graph* R,
+        landmarks* distance_landmarks, landmarks* time_landmarks) {
+    size_t n = graph_vertex_count(G);
+    size_t* name_offset = malloc((n + 1) * sizeof(size_t));
+    if (name_offset == NULL) { return false; }
+    for (size_t v = 0; v < n; v++) {
+        name_offset[v] = v < fr->location_count ? (size_t)(fr->locations[v].name - fr->names) : 0;
+    }
+
+    map_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAP_FILE_MAGIC, sizeof(header.magic));
+    header.version = MAP_FILE_VERSION;
+    header.byte_order = MAP_FILE_BYTE_ORDER;
+    header.header_size = sizeof(map_header);
+    header.size_size = sizeof(size_t);
+    header.vertex_size = sizeof(vertex_t);
+    header.double_size = sizeof(double);
+    header.n = n;
+    header.directed = graph_directed(G);
+    header.names_size = fr->names_size;
+
+    const void* data[SECTION_COUNT] = { NULL };
+    uint64_t length[SECTION_COUNT] = { 0 };
+    const size_t* offset;
+    const vertex_t* target;
+    const double* distance;
+    const double* speed;
+    graph_storage(G, &offset, &target, &distance, &speed);
+    header.m = offset[n];
+    data[SECTION_OFFSET] = offset;
+    length[SECTION_OFFSET] = (n + 1) * sizeof(size_t);
+    data[SECTION_TARGET] = target;
+    length[SECTION_TARGET] = header.m * sizeof(vertex_t);
+    data[SECTION_DISTANCE] = distance;
+    length[SECTION_DISTANCE] = header.m * sizeof(double);
+    data[SECTION_SPEED] = speed;
+    length[SECTION_SPEED] = header.m * sizeof(double);
+    data[SECTION_NAME_OFFSET] = name_offset;
+    length[SECTION_NAME_OFFSET] = n * sizeof(size_t);
+    data[SECTION_NAMES] = fr->names;
+    length[SECTION_NAMES] = fr->names_size;
+    if (R != NULL) {
+        graph_storage(R, &offset, &target, &distance, &speed);
+        header.reversed_m = offset[n];
+        data[SECTION_REVERSED_OFFSET] = offset;
+        length[SECTION_REVERSED_OFFSET] = (n + 1) * sizeof(size_t);
+        data[SECTION_REVERSED_TARGET] = target;
+        length[SECTION_REVERSED_TARGET] = header.reversed_m * sizeof(vertex_t);
+        data[SECTION_REVERSED_DISTANCE] = distance;
+        length[SECTION_REVERSED_DISTANCE] = header.reversed_m * sizeof(double);
+        data[SECTION_REVERSED_SPEED] = speed;
+        length[SECTION_REVERSED_SPEED] = header.reversed_m * sizeof(double);
+    }
+    landmark_sections(distance_landmarks, data, length, SECTION_DISTANCE_LANDMARKS);
+    landmark_sections(time_landmarks, data, length, SECTION_TIME_LANDMARKS);
+    header.distance_landmark_count = distance_landmarks != NULL ? distance_landmarks->count : 0;
+    header.time_landmark_count = time_landmarks != NULL ? time_landmarks->count : 0;
+
+    // Lay the sections out one after another at aligned offsets
+    uint64_t at = sizeof(map_header);
+    for (size_t s = 0; s < SECTION_COUNT; s++) {
+        at = (at + MAP_FILE_ALIGNMENT - 1) / MAP_FILE_ALIGNMENT * MAP_FILE_ALIGNMENT;
+        header.section[s][0] = at;
+        header.section[s][1] = length[s];
+        at += length[s];
+    }
+
+    FILE* stream = fopen(path, "wb");
+    bool ok = stream != NULL && fwrite(&header, sizeof(header), 1, stream) == 1;
+    static const char padding[MAP_FILE_ALIGNMENT] = { 0 };
+    uint64_t written = sizeof(map_header);
+    for (size_t s = 0; ok && s < SECTION_COUNT; s++) {
+        size_t pad = header.section[s][0] - written;
+        ok = fwrite(padding, 1, pad, stream) == pad
+            && (length[s] == 0 || fwrite(data[s], 1, length[s], stream) == length[s]);
+        written = header.section[s][0] + length[s];
+    }
+    if (stream != NULL && fclose(stream) != 0) ok = false;
+    free(name_offset);
+    return ok;
+}
+
+// Private helper returning section s of a mapped file if it lies inside the
+// file, is aligned, and has the expected length; NULL otherwise.
+static const void* section(map_file* self, const map_header* header, map_section s, uint64_t expected) {
+    uint64_t at = header->section[s][0];
+    uint64_t length = header->section[s][1];
+    if (length != expected || at % MAP_FILE_ALIGNMENT != 0 || at > self->size
+            || length > self->size - at) {
+        return NULL;
+    }
+    return (const char*)self->data + at;
+}
+
+// Private helper that checks the CSR arrays of a mapped graph: the rows must
+// start at 0, never run backwards, end at m, and only name vertices below n.
+// Everything that walks the graph trusts this, so it is done once at open.
+static bool valid_rows(size_t n, size_t m, const size_t* offset, const vertex_t* target) {
+    if (offset[0] != 0 || offset[n] != m) { return false; }
+    for (size_t u = 0; u < n; u++) {
+        if (offset[u] > offset[u + 1]) { return false; }
+    }
+    for (size_t e = 0; e < m; e++) {
+        if (target[e] >= n) { return false; }
+    }
+    return true;
+}
+
+// Private helper that points a landmark table at its sections.
+static landmarks* landmarks_view(map_file* self, const map_header* header, uint64_t count,
+        map_section first, char metric) {
+    size_t n = header->n;
+    const void* vertices = section(self, header, first, count * sizeof(vertex_t));
+    const void* from = section(self, header, first + 1, count * n * sizeof(double));
+    const void* to = section(self, header, first + 2, count * n * sizeof(double));
+    if (vertices == NULL || from == NULL || to == NULL) { return NULL; }
+
+    landmarks* L = malloc(sizeof(landmarks));
+    if (L == NULL) { return NULL; }
+    L->count = count;
+    L->n = n;
+    L->metric = metric;
+    L->vertices = (vertex_t*)vertices;
+    L->from = (double*)from;
+    L->to = (double*)to;
+    L->preprocessing_seconds = 0.0;
+    return L;
+}
+
+map_file* map_file_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { return NULL; }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(map_header)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return NULL; }
+
+    map_file* self = calloc(1, sizeof(map_file));
+    if (self == NULL) {
+        munmap(data, (size_t)info.st_size);
+        return NULL;
+    }
+    self->data = data;
+    self->size = (size_t)info.st_size;
+
+    const map_header* header = data;
+    bool ok = memcmp(header->magic, MAP_FILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == MAP_FILE_VERSION
+        && header->byte_order == MAP_FILE_BYTE_ORDER
+        && header->header_size == sizeof(map_header)
+        && header->size_size == sizeof(size_t)
+        && header->vertex_size == sizeof(vertex_t)
+        && header->double_size == sizeof(double)
+        && header->n < self->size && header->m < self->size && header->reversed_m < self->size
+        && header->distance_landmark_count <= header->n && header->time_landmark_count <= header->n;
+
+    size_t n = ok ? header->n : 0;
+    size_t m = ok ? header->m : 0;
+    const size_t* offset = ok ? section(self, header, SECTION_OFFSET, (n + 1) * sizeof(size_t)) : NULL;
+    const vertex_t* target = section(self, header, SECTION_TARGET, m * sizeof(vertex_t));
+    const double* distance = section(self, header, SECTION_DISTANCE, m * sizeof(double));
+    const double* speed = section(self, header, SECTION_SPEED, m * sizeof(double));
+    self->name_offset = section(self, header, SECTION_NAME_OFFSET, n * sizeof(size_t));
+    self->names = section(self, header, SECTION_NAMES, header->names_size);
+    self->names_size = header->names_size;
+    ok = ok && offset != NULL && target != NULL && distance != NULL && speed != NULL
+        && self->name_offset != NULL && self->names != NULL
+        && valid_rows(n, m, offset, target);
+    if (ok) {
+        self->map = graph_create_view(n, m, header->directed, offset, target, distance, speed);
+        ok = self->map != NULL;
+    }
+
+    if (ok && header->section[SECTION_REVERSED_OFFSET][1] > 0) {
+        size_t rm = header->reversed_m;
+        offset = section(self, header, SECTION_REVERSED_OFFSET, (n + 1) * sizeof(size_t));
+        target = section(self, header, SECTION_REVERSED_TARGET, rm * sizeof(vertex_t));
+        distance = section(self, header, SECTION_REVERSED_DISTANCE, rm * sizeof(double));
+        speed = section(self, header, SECTION_REVERSED_SPEED, rm * sizeof(double));
+        ok = offset != NULL && target != NULL && distance != NULL && speed != NULL
+            && valid_rows(n, rm, offset, target);
+        if (ok) {
+            self->reversed = graph_create_view(n, rm, header->directed, offset, target, distance, speed);
+            ok = self->reversed != NULL;
+        }
+    }
+    if (ok && header->distance_landmark_count > 0) {
+        self->distance_landmarks = landmarks_view(self, header, header->distance_landmark_count,
+                SECTION_DISTANCE_LANDMARKS, 'D');
+        ok = self->distance_landmarks != NULL;
+    }
+    if (ok && header->time_landmark_count > 0) {
+        self->time_landmarks = landmarks_view(self, header, header->time_landmark_count,
+                SECTION_TIME_LANDMARKS, 'T');
+        ok = self->time_landmarks != NULL;
+    }
+
+    if (!ok) {
+        map_file_close(self);
+        errno = EINVAL;
+        return NULL;
+    }
+    return self;
+}
+
+void map_file_close(map_file* self) {
+    if (self->map != NULL) graph_destroy(self->map);
+    if (self->reversed != NULL) graph_destroy(self->reversed);
+    free(self->distance_landmarks);
+    free(self->time_landmarks);
+    munmap(self->data, self->size);
+    free(self);
+}
+
+const char* map_file_name(map_file* self, vertex_t v) {
+    // The names are checked once here instead of all of them at open
+    size_t at = self->name_offset[v];
+    if (at >= self->names_size || memchr(self->names + at, '\0', self->names_size - at) == NULL) {
+        return "";
+    }
+    return self->names + at;
+}
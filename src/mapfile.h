@@ -0,0 +1,87 @@
+/**
+ * This header provides a binary map format that loads without parsing.
+ *
+ * A map file holds the CSR arrays of a map, its location names, and
+ * optionally the reversed map and landmark tables, each section at a 64 byte
+ * aligned offset in the layout used in memory. Opening a map file maps it
+ * and points graphs and landmarks straight at those sections, so start up
+ * costs one pass over the rows to check them rather than a parse.
+ *
+ * The format is native endian and records the sizes of the types it uses;
+ * a file written on a machine that disagrees is refused rather than
+ * converted. Bump MAP_FILE_VERSION whenever the layout changes.
+ */
+#ifndef __MAPFILE_H__
+#define __MAPFILE_H__
+
+#include "graph.h"
+#include "landmarks.h"
+
+#define MAP_FILE_VERSION 1
+
+/**
+ * Struct holding an open map file. Everything it points to lives in the
+ * mapping and is released by map_file_close, including the graphs and
+ * landmarks, which must not be destroyed by the caller.
+ */
+typedef struct map_file
+{
+    void* data;                     // the mapping
+    size_t size;                    // its length in bytes
+    graph* map;                     // the map
+    graph* reversed;                // its edge reversal, or NULL
+    landmarks* distance_landmarks;  // landmarks for 'D' trips, or NULL
+    landmarks* time_landmarks;      // landmarks for 'T' trips, or NULL
+    const size_t* name_offset;      // name of v at names + name_offset[v]
+    const char* names;              // NUL terminated location names
+    size_t names_size;              // length of names in bytes
+} map_file;
+
+/**
+ * Writes a map and its preprocessing to a map file.
+ *
+ * @param  path               where to write the file
+ * @param  G                  the map
+ * @param  fr                 the parsed input of G, for the location names
+ * @param  R                  the edge reversal of G, or NULL
+ * @param  distance_landmarks landmarks of G for distance, or NULL
+ * @param  time_landmarks     landmarks of G for time, or NULL
+ * @return                    true on success, false if the file could not
+ *                            be written (errno tells why)
+ */
+bool map_file_write(const char* path, graph* G, file_record* fr, graph* R,
+        landmarks* distance_landmarks, landmarks* time_landmarks);
+
+/**
+ * Opens a map file written by map_file_write.
+ *
+ * Runtime: O(n + m) to check the rows of the map and its reversal, plus the
+ *          page faults of whatever is used later
+ *
+ * @param  path the file to open
+ * @return      the open map file, or NULL if the file cannot be read, is
+ *              not a map file, was written for another version, byte
+ *              order, or type sizes, or holds rows that are out of order
+ *              or name vertices that do not exist
+ */
+map_file* map_file_open(const char* path);
+
+/**
+ * Unmaps a map file and frees the graphs and landmarks it handed out.
+ *
+ * @param self the map file being closed
+ */
+void map_file_close(map_file* self);
+
+/**
+ * Returns the name of a location.
+ *
+ * Runtime: O(1)
+ *
+ * @param  self the map file
+ * @param  v    a vertex of the map
+ * @return      the name of v
+ */
+const char* map_file_name(map_file* self, vertex_t v);
+
+#endif//__MAPFILE_H__
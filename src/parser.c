@@ -1,114 +1,856 @@
 // Implementations of the declarations in parser.h.
 #include "parser.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Threads used for the road section; 0 means one per online core.
+static size_t parse_threads = 0;
+
+// Road lines measured to guess where the road section ends.
+#define PARSE_SAMPLE_ROADS 1024
+
+// Cursor over the part of the input not parsed yet. line counts the lines
+// consumed so far, so it is the number of the line last returned.
+typedef struct scanner
+{
+    const char* at;
+    const char* end;
+    size_t line;
+    const char* error;
+    size_t error_line;
+} scanner;
+
+// Private function to record the first error found.
+static void fail(scanner* s, const char* message)
+{
+    if (s->error == NULL)
+    {
+        s->error = message;
+        s->error_line = s->line;
+    }
+}
+
+// Private function to test for a blank that may separate fields
+static bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
 
 // Private function to test if a line is blank
-bool is_empty(char* str)
+static bool is_empty(const char* line, size_t len)
 {
-    for (size_t i = 0; str[i] != '\0'; i++)
+    for (size_t i = 0; i < len; i++)
     {
-        if (!isspace(str[i])) return false;
+        if (!isspace((unsigned char)line[i])) return false;
     }
     return true;
 }
 
 // Private function to test if a line is a comment
-bool is_comment(char* str)
+static bool is_comment(const char* line, size_t len)
 {
-    return (str[0] == '#');
+    return (len > 0 && line[0] == '#');
 }
 
-// Private function to get the next line that is not empty/comment.
-void next_line(char* line, size_t line_len, FILE* stream)
+// Private function to split off the line starting at at. Returns where the
+// next line starts; len excludes the line terminator.
+static const char* take_line(const char* at, const char* end, size_t* len)
 {
-    // Skip empty lines and comments
-    while ((fgets(line, line_len, stream) != NULL)
-                    && (is_empty(line) || is_comment(line)))
-    {/* empty loop */}
+    const char* newline = memchr(at, '\n', end - at);
+    const char* stop = newline != NULL ? newline : end;
+    *len = stop - at;
 
-    // Remove trailing newline
-    size_t len = strlen(line);
-    if (line[len-1] == '\n') line[len-1] = '\0';
+    // Remove a trailing carriage return
+    if (*len > 0 && at[*len - 1] == '\r') (*len)--;
+    return newline != NULL ? newline + 1 : end;
 }
 
-// File parser
-file_record parse_file(FILE* stream)
+// Private function to test if a line holds a record.
+static bool is_record(const char* line, size_t len)
 {
-    file_record fr;
-    char line[STRING_LEN+1];
-    char* start = NULL;
-    char* end = NULL;
+    return !is_empty(line, len) && !is_comment(line, len);
+}
 
-    // Read in number of locations
-    next_line(line, STRING_LEN+1, stream);
-    fr.location_count = strtoul(line, &end, 10);
-    assert(line != end);
+// Private function to get the next line that is not empty/comment. The line
+// is left in the input. Returns false at the end of the input.
+static bool next_line(scanner* s, const char** line, size_t* len)
+{
+    while (s->at < s->end)
+    {
+        *line = s->at;
+        s->at = take_line(s->at, s->end, len);
+        s->line++;
+        if (is_record(*line, *len)) return true;
+    }
+    fail(s, "unexpected end of input");
+    return false;
+}
 
-    // Read in location names
-    fr.locations = malloc(fr.location_count * sizeof(location_record));
-    for (size_t i = 0; i < fr.location_count; i++)
+// Private function to read an unsigned integer field, like strtoul. A value
+// too large for a vertex_t is refused rather than wrapped.
+static bool parse_unsigned(const char** at, const char* end, vertex_t* value)
+{
+    const char* p = *at;
+    while (p < end && is_blank(*p)) p++;
+    if (p < end && *p == '+') p++;
+    const char* digits = p;
+    *value = 0;
+    bool overflow = false;
+    while (p < end && *p >= '0' && *p <= '9')
     {
-        next_line(line, STRING_LEN+1, stream);
-        fr.locations[i].id = i;
-        fr.locations[i].name = malloc((STRING_LEN+1) * sizeof(char));
-        strcpy(fr.locations[i].name, line);
+        vertex_t digit = (vertex_t)(*p - '0');
+        if (*value > ((vertex_t)-1 - digit) / 10) overflow = true;
+        *value = *value * 10 + digit;
+        p++;
     }
+    *at = p;
+    return p != digits && !overflow;
+}
 
-    // Read in number of roads
-    next_line(line, STRING_LEN+1, stream);
-    fr.road_count = strtoul(line, &end, 10);
-    assert(line != end);
+// Exact powers of ten, for the fast path of parse_double.
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
-    // Read in road information
-    fr.roads = malloc(fr.road_count * sizeof(road_record));
-    for (size_t i = 0; i < fr.road_count; i++)
+// Private function to read a decimal field with strtod as a fallback. The
+// field is delimited by blanks since the input is not NUL terminated.
+static bool parse_slow(const char* start, const char* end, const char** stop, double* value)
+{
+    const char* p = start;
+    while (p < end && !is_blank(*p)) p++;
+    size_t len = p - start;
+    char small[64];
+    char* copy = len < sizeof(small) ? small : malloc(len + 1);
+    if (copy == NULL) return false;
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+    char* parsed = NULL;
+    *value = strtod(copy, &parsed);
+    bool ok = parsed != copy;
+    *stop = start + (parsed - copy);
+    if (copy != small) free(copy);
+    return ok;
+}
+
+// Private function to read a floating point field, like strtod.
+//
+// Plain decimals such as "12.75" are read as an integer mantissa and a power
+// of ten. When the mantissa has at most 53 bits and the power is at most 22
+// both are exact doubles, so one multiplication or division rounds correctly
+// (Clinger's fast path). Everything else goes through strtod.
+static bool parse_double(const char** at, const char* end, double* result)
+{
+    const char* p = *at;
+    while (p < end && is_blank(*p)) p++;
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
     {
-        next_line(line, STRING_LEN+1, stream);
-        start = line;
-        fr.roads[i].start = strtoul(start, &end, 10);
-        assert(start != end);
-        start = end;
-        fr.roads[i].end = strtoul(start, &end, 10);
-        assert(start != end);
-        start = end;
-        fr.roads[i].distance = strtod(start, &end);
-        assert(start != end);
-        start = end;
-        fr.roads[i].speed = strtod(start, &end);
-        assert(start != end);
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    bool dropped = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        any = true;
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            if (mantissa > 0) digits++;
+        }
+        else
+        {
+            dropped = true;
+        }
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                if (mantissa > 0) digits++;
+                exponent--;
+            }
+            else
+            {
+                dropped = true;
+            }
+        }
+    }
+    if (any && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool exponent_negative = false;
+        if (q < end && (*q == '+' || *q == '-'))
+        {
+            exponent_negative = *q == '-';
+            q++;
+        }
+        if (q < end && *q >= '0' && *q <= '9')
+        {
+            int written = 0;
+            for (; q < end && *q >= '0' && *q <= '9'; q++)
+            {
+                if (written < 10000) written = written * 10 + (*q - '0');
+            }
+            exponent += exponent_negative ? -written : written;
+            p = q;
+        }
     }
 
-    // Read in number of trips
-    next_line(line, STRING_LEN+1, stream);
-    fr.trip_count = strtoul(line, &end, 10);
-    assert(line != end);
+    bool delimited = p == end || isspace((unsigned char)*p);
+    if (!any || !delimited || dropped || mantissa > (UINT64_C(1) << 53)
+            || exponent < -22 || exponent > 22)
+    {
+        return parse_slow(start, end, at, result);
+    }
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+    *at = p;
+    *result = negative ? -value : value;
+    return true;
+}
 
-    // Read in trip information
-    fr.trips = malloc(fr.trip_count * sizeof(trip_record));
-    for (size_t i = 0; i < fr.trip_count; i++)
+// Private function to read a count line. Every record takes at least two
+// bytes of the input but the last, so a count that exceeds what is left is
+// refused here; that bounds whatever is sized from it by the input length.
+static size_t parse_count(scanner* s)
+{
+    const char* line;
+    size_t len;
+    vertex_t count = 0;
+    if (next_line(s, &line, &len) && !parse_unsigned(&line, line + len, &count))
     {
-        next_line(line, STRING_LEN+1, stream);
-        start = line;
-        fr.trips[i].start = strtoul(start, &end, 10);
-        assert(start != end);
-        start = end;
-        fr.trips[i].end = strtoul(start, &end, 10);
-        assert(start != end);
+        fail(s, "expected a count");
+        return 0;
+    }
+    if (count > ((size_t)(s->end - s->at) + 1) / 2)
+    {
+        fail(s, "count is larger than the rest of the input");
+        return 0;
+    }
+    return count;
+}
+
+// Private function to read one road segment line. Returns what is wrong
+// with it, or NULL.
+static const char* parse_road(const char* line, size_t len, size_t location_count, road_record* road)
+{
+    const char* end = line + len;
+    if (!parse_unsigned(&line, end, &road->start) || !parse_unsigned(&line, end, &road->end)
+            || !parse_double(&line, end, &road->distance) || !parse_double(&line, end, &road->speed))
+    {
+        return "expected a road: start end distance speed";
+    }
+    if (road->start >= location_count || road->end >= location_count)
+    {
+        return "road endpoint is not a location";
+    }
+    return NULL;
+}
+
+// Private function hashing a name (FNV-1a).
+static uint64_t hash_name(const char* name, size_t len)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+// Private function to read the location names into one block of the
+// record's arena, storing each distinct name once. A name takes no more than
+// its line and a NUL, so a first pass over the lines of the section sizes
+// the block and the names are then written straight into it.
+static void parse_locations(scanner* s, file_record* fr)
+{
+    size_t records = 0;
+    size_t len;
+    const char* at = s->at;
+    while (at < s->end && records < fr->location_count)
+    {
+        const char* line = at;
+        at = take_line(at, s->end, &len);
+        if (is_record(line, len)) records++;
+    }
+
+    // location_count is bounded by the input length, so this cannot wrap
+    size_t slots = 16;
+    while (slots / 2 < fr->location_count) slots *= 2;
+    size_t* table = calloc(slots, sizeof(size_t)); // location index + 1, or 0
+    char* names = arena_alloc(fr->memory, (size_t)(at - s->at) + 1);
+    size_t used = 0;
+    if (table == NULL || names == NULL)
+    {
+        fail(s, "out of memory");
+        fr->location_count = 0;
+    }
+
+    for (size_t i = 0; i < fr->location_count; i++)
+    {
+        const char* line;
+        if (!next_line(s, &line, &len))
+        {
+            fr->location_count = i;
+            break;
+        }
+        fr->locations[i].id = i;
+        fr->locations[i].name_length = len;
+
+        size_t slot = hash_name(line, len) & (slots - 1);
+        while (table[slot] != 0)
+        {
+            location_record* other = &fr->locations[table[slot] - 1];
+            if (other->name_length == len && memcmp(other->name, line, len) == 0) break;
+            slot = (slot + 1) & (slots - 1);
+        }
+        if (table[slot] != 0)
+        {
+            fr->locations[i].name = fr->locations[table[slot] - 1].name;
+            continue;
+        }
+
+        memcpy(names + used, line, len);
+        names[used + len] = '\0';
+        fr->locations[i].name = names + used;
+        used += len + 1;
+        table[slot] = i + 1;
+    }
+
+    fr->names = names;
+    fr->names_size = used;
+    free(table);
+}
+
+// A newline aligned piece of the input handled by one thread while the
+// road section is parsed in parallel.
+typedef struct road_chunk
+{
+    const char* start;
+    const char* end;
+    size_t lines;          // lines in the chunk
+    size_t records;        // lines holding a record
+    size_t first_line;     // number of the line before the chunk
+    size_t first_record;   // index of the first record, counted from the roads
+    file_record* fr;
+    const char* resume;    // start of the record after the roads, if here
+    size_t resume_line;
+    const char* error;
+    size_t error_line;
+} road_chunk;
+
+// Private function run by each thread to count the lines of its chunk.
+static void* count_chunk(void* arg)
+{
+    road_chunk* chunk = arg;
+    size_t len;
+    for (const char* at = chunk->start; at < chunk->end; )
+    {
+        const char* line = at;
+        at = take_line(at, chunk->end, &len);
+        chunk->lines++;
+        if (is_record(line, len)) chunk->records++;
+    }
+    return NULL;
+}
+
+// Private function run by each thread to parse the roads of its chunk.
+static void* parse_chunk(void* arg)
+{
+    road_chunk* chunk = arg;
+    file_record* fr = chunk->fr;
+    size_t record = chunk->first_record;
+    size_t line_number = chunk->first_line;
+    size_t len;
+    for (const char* at = chunk->start; at < chunk->end && chunk->error == NULL; )
+    {
+        const char* line = at;
+        at = take_line(at, chunk->end, &len);
+        line_number++;
+        if (!is_record(line, len)) continue;
+        if (record >= fr->road_count)
+        {
+            if (record == fr->road_count)
+            {
+                chunk->resume = line;
+                chunk->resume_line = line_number - 1;
+            }
+            break;
+        }
+        chunk->error = parse_road(line, len, fr->location_count, &fr->roads[record]);
+        chunk->error_line = line_number;
+        record++;
+    }
+    return NULL;
+}
+
+// Private function to run a function over every chunk, one thread each.
+static void run_chunks(road_chunk* chunks, size_t count, void* (*work)(void*))
+{
+    pthread_t threads[count];
+    bool started[count];
+    for (size_t k = 1; k < count; k++)
+    {
+        started[k] = pthread_create(&threads[k], NULL, work, &chunks[k]) == 0;
+    }
+    work(&chunks[0]);
+    for (size_t k = 1; k < count; k++)
+    {
+        // A thread that could not be started is made up for here
+        if (started[k]) pthread_join(threads[k], NULL);
+        else work(&chunks[k]);
+    }
+}
+
+// Private function to read road lines on several threads, from road done on.
+//
+// Where the roads end is guessed from the length of the next lines, with an
+// eighth to spare, so that the trips after them are barely touched. That
+// region is cut into newline aligned chunks. A first pass counts the records
+// of each chunk, and their prefix sums tell every chunk which road its first
+// record is, so the second pass parses each chunk straight into its slots of
+// the road array. Returns the roads parsed; the scanner is moved past them,
+// to the first record after the roads once they are all read.
+static size_t parse_roads_parallel(scanner* s, file_record* fr, size_t thread_count, size_t done)
+{
+    size_t left = fr->road_count - done;
+    size_t sampled = 0;
+    size_t len;
+    const char* at = s->at;
+    while (at < s->end && sampled < PARSE_SAMPLE_ROADS)
+    {
+        const char* line = at;
+        at = take_line(at, s->end, &len);
+        if (is_record(line, len)) sampled++;
+    }
+    size_t size = s->end - s->at;
+    size_t per_road = sampled > 0 ? (size_t)(at - s->at) / sampled + 1 : size;
+    size_t region = per_road <= size / left ? left * per_road : size;
+    region = region / 8 <= size - region ? region + region / 8 : size;
+    const char* region_end = s->at + region;
+    if (region_end < s->end && region_end[-1] != '\n')
+    {
+        const char* newline = memchr(region_end, '\n', s->end - region_end);
+        region_end = newline != NULL ? newline + 1 : s->end;
+    }
+
+    road_chunk chunks[thread_count];
+    region = region_end - s->at;
+    const char* start = s->at;
+    for (size_t k = 0; k < thread_count; k++)
+    {
+        const char* end = k + 1 == thread_count ? region_end : s->at + region / thread_count * (k + 1);
+        if (end < start) end = start;
+        if (end < region_end && end > s->at && end[-1] != '\n')
+        {
+            const char* newline = memchr(end, '\n', region_end - end);
+            end = newline != NULL ? newline + 1 : region_end;
+        }
+        road_chunk chunk = { start, end, 0, 0, 0, 0, fr, NULL, 0, NULL, 0 };
+        chunks[k] = chunk;
         start = end;
-        while (isspace(*start)) start++;
-        fr.trips[i].type = *start;
-        assert(fr.trips[i].type == 'D' || fr.trips[i].type == 'T');
     }
 
+    run_chunks(chunks, thread_count, count_chunk);
+    size_t line = s->line;
+    size_t record = done;
+    for (size_t k = 0; k < thread_count; k++)
+    {
+        chunks[k].first_line = line;
+        chunks[k].first_record = record;
+        line += chunks[k].lines;
+        record += chunks[k].records;
+    }
+    run_chunks(chunks, thread_count, parse_chunk);
+
+    // Report the earliest error, as a sequential parse would
+    for (size_t k = 0; k < thread_count; k++)
+    {
+        if (chunks[k].error != NULL)
+        {
+            s->line = chunks[k].error_line;
+            fail(s, chunks[k].error);
+            return done;
+        }
+    }
+    for (size_t k = 0; k < thread_count; k++)
+    {
+        if (chunks[k].resume != NULL)
+        {
+            s->at = chunks[k].resume;
+            s->line = chunks[k].resume_line;
+            return fr->road_count;
+        }
+    }
+    s->at = region_end;
+    s->line = line;
+    return record < fr->road_count ? record : fr->road_count;
+}
+
+// Private function to read the road lines. Large sections are parsed on
+// several threads a region at a time; the last few roads, or all of them
+// with one thread, are parsed here.
+static void parse_roads(scanner* s, file_record* fr)
+{
+    size_t thread_count = parse_threads;
+    if (thread_count == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (size_t)online : 1;
+    }
+    if (thread_count > PARSE_MAX_THREADS) thread_count = PARSE_MAX_THREADS;
+
+    size_t i = 0;
+    while (thread_count > 1 && s->error == NULL && s->at < s->end
+            && fr->road_count - i >= PARSE_PARALLEL_ROADS)
+    {
+        i = parse_roads_parallel(s, fr, thread_count, i);
+    }
+
+    const char* line;
+    size_t len;
+    for (; i < fr->road_count && s->error == NULL; i++)
+    {
+        if (!next_line(s, &line, &len)) break;
+        const char* error = parse_road(line, len, fr->location_count, &fr->roads[i]);
+        if (error != NULL) fail(s, error);
+    }
+}
+
+// Private function to read one trip line. Returns what is wrong with it, or
+// NULL. Endpoints are checked against location_count unless it is 0.
+static const char* parse_trip(const char* line, size_t len, size_t location_count, trip_record* trip)
+{
+    const char* end = line + len;
+    trip->type = '\0';
+    if (parse_unsigned(&line, end, &trip->start) && parse_unsigned(&line, end, &trip->end))
+    {
+        while (line < end && is_blank(*line)) line++;
+        if (line < end) trip->type = *line;
+    }
+    if (trip->type != 'D' && trip->type != 'T')
+    {
+        return "expected a trip: start end D|T";
+    }
+    if (location_count > 0 && (trip->start >= location_count || trip->end >= location_count))
+    {
+        return "trip endpoint is not a location";
+    }
+    return NULL;
+}
+
+// Private function to read the trip count and trips.
+static void parse_trip_section(scanner* s, file_record* fr)
+{
+    const char* line;
+    size_t len;
+    fr->trip_count = parse_count(s);
+    fr->trips = s->error == NULL ? arena_calloc(fr->memory, fr->trip_count, sizeof(trip_record)) : NULL;
+    if (fr->trips == NULL)
+    {
+        if (s->error == NULL && fr->trip_count > 0) fail(s, "out of memory");
+        fr->trip_count = 0;
+    }
+    for (size_t i = 0; i < fr->trip_count && s->error == NULL; i++)
+    {
+        if (!next_line(s, &line, &len)) break;
+        const char* error = parse_trip(line, len, fr->location_count, &fr->trips[i]);
+        if (error != NULL) fail(s, error);
+    }
+}
+
+// Parser for the map sections alone; advances the scanner past them
+static file_record parse_map_only(scanner* s)
+{
+    file_record fr = { 0, NULL, 0, NULL, 0, NULL, NULL, 0, NULL, 0, 0, NULL };
+    fr.memory = arena_create();
+    if (fr.memory == NULL)
+    {
+        fail(s, "out of memory");
+        return fr;
+    }
+
+    // Read in location names
+    fr.location_count = parse_count(s);
+    if (s->error == NULL)
+    {
+        fr.locations = arena_calloc(fr.memory, fr.location_count, sizeof(location_record));
+        if (fr.locations == NULL && fr.location_count > 0) fail(s, "out of memory");
+    }
+    if (s->error != NULL)
+    {
+        fr.location_count = 0;
+        return fr;
+    }
+    parse_locations(s, &fr);
+    if (s->error != NULL) return fr;
+
+    // Read in road information
+    fr.road_count = parse_count(s);
+    if (s->error == NULL)
+    {
+        fr.roads = arena_calloc(fr.memory, fr.road_count, sizeof(road_record));
+        if (fr.roads == NULL && fr.road_count > 0) fail(s, "out of memory");
+    }
+    if (s->error != NULL)
+    {
+        fr.road_count = 0;
+        return fr;
+    }
+    parse_roads(s, &fr);
     return fr;
 }
 
-void file_record_destroy(file_record fr)
+// Parser over the scanner; advances it past everything that was read
+static file_record parse(scanner* s)
 {
-    for (size_t i = 0; i < fr.location_count; i++)
+    file_record fr = parse_map_only(s);
+    if (s->error == NULL) parse_trip_section(s, &fr);
+    return fr;
+}
+
+// Parser for a trip file: the trip section alone
+static file_record parse_trips_only(scanner* s)
+{
+    file_record fr = { 0, NULL, 0, NULL, 0, NULL, NULL, 0, NULL, 0, 0, NULL };
+    fr.memory = arena_create();
+    if (fr.memory == NULL)
     {
-        free(fr.locations[i].name);
+        fail(s, "out of memory");
+        return fr;
     }
-    free(fr.locations);
-    free(fr.roads);
-    free(fr.trips);
+    parse_trip_section(s, &fr);
+    return fr;
+}
+
+// Private function that runs a parser over a scanner and records its error.
+static file_record run_parser(scanner* s, file_record (*parser)(scanner*))
+{
+    file_record fr = parser(s);
+    fr.error = s->error;
+    fr.error_line = s->error_line;
+    fr.lines_read = s->line;
+    return fr;
+}
+
+file_record parse_buffer(const char* data, size_t size)
+{
+    scanner s = { data, data + size, 0, NULL, 0 };
+    return run_parser(&s, parse);
+}
+
+// Private function to parse the map sections of a stream that cannot be
+// mapped. Lines are copied until the road section is complete, so that the
+// trips after it are left in the stream.
+static file_record parse_map_lines(FILE* stream)
+{
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    char* data = malloc(capacity);
+    char* line = NULL;
+    size_t line_capacity = 0;
+    ssize_t got;
+    size_t records = 0;
+    size_t wanted = 1;      // records up to and including the next count
+    bool roads = false;     // the count read last was the road count
+    while (data != NULL && records < wanted && (got = getline(&line, &line_capacity, stream)) > 0)
+    {
+        if (size + (size_t)got > capacity)
+        {
+            while (size + (size_t)got > capacity) capacity *= 2;
+            char* grown = realloc(data, capacity);
+            if (grown == NULL) free(data);
+            data = grown;
+            if (data == NULL) break;
+        }
+        memcpy(data + size, line, got);
+        size += got;
+
+        size_t len;
+        take_line(line, line + got, &len);
+        if (!is_record(line, len)) continue;
+        records++;
+        if (records == wanted && !roads)
+        {
+            // a count line: the location count, then the road count
+            const char* at = line;
+            vertex_t count = 0;
+            // Stop copying at a count that cannot be right; the parser
+            // then reports it
+            if (!parse_unsigned(&at, line + len, &count) || count > SIZE_MAX - wanted - 1) break;
+            roads = wanted > 1;
+            wanted += count + (roads ? 0 : 1);
+        }
+    }
+    free(line);
+    if (data == NULL)
+    {
+        file_record fr = { 0, NULL, 0, NULL, 0, NULL, NULL, 0, "out of memory", 0, 0, NULL };
+        return fr;
+    }
+    scanner s = { data, data + size, 0, NULL, 0 };
+    file_record fr = run_parser(&s, parse_map_only);
+    free(data);
+    return fr;
+}
+
+// Private function that runs a parser over a whole stream.
+static file_record parse_stream(FILE* stream, file_record (*parser)(scanner*))
+{
+    // Regular files are mapped and scanned in place
+    struct stat info;
+    int fd = fileno(stream);
+    off_t offset = ftello(stream);
+    if (fd >= 0 && offset >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)
+            && info.st_size > offset)
+    {
+        size_t size = (size_t)info.st_size;
+        char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, size, MADV_SEQUENTIAL);
+            scanner s = { data + offset, data + size, 0, NULL, 0 };
+            file_record fr = run_parser(&s, parser);
+            fseeko(stream, s.at - data, SEEK_SET);
+            munmap(data, size);
+            return fr;
+        }
+    }
+
+    // Anything else is read into memory first, to its end unless only the
+    // map is wanted
+    if (parser == parse_map_only)
+    {
+        return parse_map_lines(stream);
+    }
+    size_t capacity = 1 << 16;
+    size_t size = 0;
+    char* data = malloc(capacity);
+    size_t got;
+    while (data != NULL && (got = fread(data + size, 1, capacity - size, stream)) > 0)
+    {
+        size += got;
+        if (size == capacity)
+        {
+            capacity *= 2;
+            char* grown = realloc(data, capacity);
+            if (grown == NULL) free(data);
+            data = grown;
+        }
+    }
+    if (data == NULL)
+    {
+        file_record fr = { 0, NULL, 0, NULL, 0, NULL, NULL, 0, "out of memory", 0, 0, NULL };
+        return fr;
+    }
+    scanner s = { data, data + size, 0, NULL, 0 };
+    file_record fr = run_parser(&s, parser);
+    free(data);
+    return fr;
+}
+
+// File parser
+file_record parse_file(FILE* stream)
+{
+    return parse_stream(stream, parse);
+}
+
+file_record parse_trips(FILE* stream)
+{
+    return parse_stream(stream, parse_trips_only);
+}
+
+file_record parse_map(FILE* stream)
+{
+    return parse_stream(stream, parse_map_only);
+}
+
+void trip_reader_init(trip_reader* self, FILE* stream, size_t location_count, size_t line)
+{
+    self->stream = stream;
+    self->line = NULL;
+    self->capacity = 0;
+    self->line_number = line;
+    self->location_count = location_count;
+    self->remaining = SIZE_MAX;
+    self->started = false;
+    self->error = NULL;
+    self->error_line = 0;
+}
+
+bool trip_reader_next(trip_reader* self, trip_record* trip)
+{
+    ssize_t got;
+    while (self->error == NULL && self->remaining > 0
+            && (got = getline(&self->line, &self->capacity, self->stream)) > 0)
+    {
+        self->line_number++;
+        size_t len;
+        take_line(self->line, self->line + got, &len);
+        if (!is_record(self->line, len)) continue;
+
+        // A first record holding a single number is the trip count
+        const char* at = self->line;
+        const char* end = self->line + len;
+        vertex_t count;
+        if (!self->started && parse_unsigned(&at, end, &count))
+        {
+            while (at < end && is_blank(*at)) at++;
+            if (at == end)
+            {
+                self->started = true;
+                self->remaining = count;
+                continue;
+            }
+        }
+        self->started = true;
+
+        const char* error = parse_trip(self->line, len, self->location_count, trip);
+        if (error != NULL)
+        {
+            self->error = error;
+            self->error_line = self->line_number;
+            return false;
+        }
+        if (self->remaining != SIZE_MAX) self->remaining--;
+        return true;
+    }
+    if (self->error == NULL && self->remaining != SIZE_MAX && self->remaining > 0)
+    {
+        self->error = "unexpected end of input";
+        self->error_line = self->line_number;
+    }
+    return false;
+}
+
+void trip_reader_destroy(trip_reader* self)
+{
+    free(self->line);
+    self->line = NULL;
+    self->capacity = 0;
+}
+
+void parse_set_threads(size_t threads)
+{
+    parse_threads = threads;
+}
+
+void file_record_destroy(file_record fr)
+{
+    arena_destroy(fr.memory);
 }
@@ -10,18 +10,30 @@
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <stdint.h>
+#include "arena.h"
 
-#define STRING_LEN 100
 typedef unsigned long vertex_t;
 
+// Road sections with at least this many roads are parsed on several threads.
+#ifndef PARSE_PARALLEL_ROADS
+#define PARSE_PARALLEL_ROADS 65536
+#endif
+
+// Most threads the road section is split across.
+#define PARSE_MAX_THREADS 64
+
 /**
  * A struct with the information for a location in the map.
- * Contains the associated vertex id and the location name.
+ * Contains the associated vertex id and the location name. The name points
+ * into the name arena of the file_record, is NUL terminated, and is shared
+ * by every location with the same name.
  */
 typedef struct location_record
 {
     vertex_t id;
     char* name;
+    size_t name_length;
 } location_record;
 
 /**
@@ -61,12 +73,43 @@ typedef struct file_record
     road_record* roads; // Array of roads
     size_t trip_count;
     trip_record* trips; // Array of trips
+    char* names; // Arena holding every distinct location name
+    size_t names_size;
+    const char* error; // NULL if the input was valid, else what was wrong
+    size_t error_line; // Line of the input the error was found on
+    size_t lines_read; // Lines of the input consumed by the parser
+    arena* memory; // Owns the arrays and names above
 } file_record;
 
+/**
+ * Reads trips one at a time from a stream, so that each can be answered
+ * before the next arrives. Memory use does not depend on the number of
+ * trips.
+ */
+typedef struct trip_reader
+{
+    FILE* stream;
+    char* line;             // the line last read
+    size_t capacity;        // allocated length of line
+    size_t line_number;     // lines read so far
+    size_t location_count;  // bound checked on trip endpoints, 0 for none
+    size_t remaining;       // trips left if a count was given, else SIZE_MAX
+    bool started;           // a record has been read
+    const char* error;      // NULL, or what was wrong with the input
+    size_t error_line;      // line the error was found on
+} trip_reader;
+
 /**
  * Reads a valid input from stream
  *
- * Basic error checking is done with asserts.
+ * A regular file is memory mapped and scanned in a single pass from the
+ * current position, which afterwards is just past the last line read. Any
+ * other stream is read to its end first. Names may be of any length. Large
+ * road sections are parsed on several threads; see parse_set_threads.
+ *
+ * Invalid input is reported through the error and error_line fields, which
+ * the caller must check. Parsing stops at the first error; the record must
+ * still be destroyed, but its other contents are incomplete.
  *
  * @param  stream input stream
  * @return        parsed output
@@ -74,7 +117,80 @@ typedef struct file_record
 file_record parse_file(FILE* stream);
 
 /**
- * Frees all memory associated with a file_record.
+ * Reads a trip file from stream: a trip count followed by that many trips,
+ * in the format of the trip section of a full input. The other sections of
+ * the returned record are empty. Errors are reported as for parse_file.
+ *
+ * @param  stream input stream
+ * @return        parsed trips
+ */
+file_record parse_trips(FILE* stream);
+
+/**
+ * Reads the location and road sections from stream, leaving it positioned at
+ * the trip section, which can then be read with a trip_reader. The trip
+ * fields of the returned record are empty. Errors are reported as for
+ * parse_file.
+ *
+ * @param  stream input stream
+ * @return        parsed map
+ */
+file_record parse_map(FILE* stream);
+
+/**
+ * Starts reading trips from stream.
+ *
+ * The trips are in the format of a trip section: comments and blank lines
+ * are skipped, and a first line holding a single number is the trip count,
+ * after which reading stops at that many trips. Without a count trips are
+ * read until the end of the stream.
+ *
+ * @param self           the reader being initialized
+ * @param stream         the input, positioned at the trips
+ * @param location_count trip endpoints must be below this, or 0 to not check
+ * @param line           lines of the stream already read, for error lines
+ */
+void trip_reader_init(trip_reader* self, FILE* stream, size_t location_count, size_t line);
+
+/**
+ * Reads the next trip, blocking until a whole line is available.
+ *
+ * @param  self      the reader
+ * @param  trip[out] assigned the trip read
+ * @return           true if a trip was read, false at the end of the trips
+ *                   or on an error, which is then left in self->error
+ */
+bool trip_reader_next(trip_reader* self, trip_record* trip);
+
+/**
+ * Frees the memory held by a trip reader; the stream is left open.
+ *
+ * @param self the reader
+ */
+void trip_reader_destroy(trip_reader* self);
+
+/**
+ * Reads a valid input held in memory, which need not be NUL terminated.
+ * Errors are reported as for parse_file.
+ *
+ * @param  data the input
+ * @param  size the length of the input in bytes
+ * @return      parsed output
+ */
+file_record parse_buffer(const char* data, size_t size);
+
+/**
+ * Sets how many threads parse a large road section. The section is cut into
+ * newline aligned chunks, one per thread, and each thread parses its chunk
+ * straight into the road array. The default, 0, uses one thread per online
+ * core; 1 parses sequentially.
+ *
+ * @param threads the number of threads, at most PARSE_MAX_THREADS are used
+ */
+void parse_set_threads(size_t threads);
+
+/**
+ * Frees all memory associated with a file_record: its arena, in one call.
  *
  * @param fr the file record to be freed
  */
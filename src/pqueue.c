@@ -2,53 +2,189 @@
 
 // For pqueue_print
 #include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if PQUEUE_ARITY < 2
+#error "PQUEUE_ARITY must be at least 2"
+#endif
+
+// Heap index i is stored at array slot i + PQUEUE_PAD. The children of i,
+// D*i+1 ... D*i+D, then occupy the slots D*(i+1) ... D*(i+1)+D-1, so every
+// group of siblings starts on a multiple of D from a 64-byte aligned base.
+#define PQUEUE_PAD (PQUEUE_ARITY - 1)
 
 // Get parent index
 size_t parent(size_t child)
 {
     assert(child > 0);
-    return (child - 1) / 2;
+    return (child - 1) / PQUEUE_ARITY;
+}
+
+// Get first child index
+size_t first_child(size_t parent)
+{
+    return PQUEUE_ARITY*parent + 1;
+}
+
+
+// Private helper that finds the smallest of count children starting at p
+static size_t min_child_scalar(const double *p, size_t count)
+{
+    size_t best = 0;
+    for (size_t k = 1; k < count; ++k)
+    {
+        if (p[k] < p[best]) best = k;
+    }
+    return best;
+}
+
+
+// Private helper that finds the smallest of a full group of PQUEUE_ARITY
+// children. p is aligned to PQUEUE_ARITY doubles, so the vector loads below
+// are aligned. Ties resolve to the leftmost child, as in the scalar loop.
+static size_t min_child_full(const double *p)
+{
+#if defined(__AVX__) && PQUEUE_ARITY % 4 == 0
+    __m256d m = _mm256_load_pd(p);
+    for (size_t k = 4; k < PQUEUE_ARITY; k += 4) m = _mm256_min_pd(m, _mm256_load_pd(p + k));
+    __m128d h = _mm_min_pd(_mm256_castpd256_pd128(m), _mm256_extractf128_pd(m, 1));
+    h = _mm_min_sd(h, _mm_unpackhi_pd(h, h));
+    __m256d best = _mm256_set1_pd(_mm_cvtsd_f64(h));
+    for (size_t k = 0; k < PQUEUE_ARITY; k += 4)
+    {
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_load_pd(p + k), best, _CMP_EQ_OQ));
+        if (mask != 0) return k + (size_t)__builtin_ctz(mask);
+    }
+    return 0;
+#elif defined(__SSE2__) && PQUEUE_ARITY % 2 == 0
+    __m128d m = _mm_load_pd(p);
+    for (size_t k = 2; k < PQUEUE_ARITY; k += 2) m = _mm_min_pd(m, _mm_load_pd(p + k));
+    m = _mm_min_sd(m, _mm_unpackhi_pd(m, m));
+    __m128d best = _mm_unpacklo_pd(m, m);
+    for (size_t k = 0; k < PQUEUE_ARITY; k += 2)
+    {
+        int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_load_pd(p + k), best));
+        if (mask != 0) return k + (size_t)__builtin_ctz(mask);
+    }
+    return 0;
+#else
+    return min_child_scalar(p, PQUEUE_ARITY);
+#endif
+}
+
+
+// Private helper that moves a buffer into a larger cache-aligned allocation.
+// The old buffer is freed on success and left untouched on failure.
+static void* aligned_grow(void *old, size_t old_bytes, size_t new_bytes)
+{
+    size_t rounded = (new_bytes + PQUEUE_ALIGNMENT - 1) / PQUEUE_ALIGNMENT * PQUEUE_ALIGNMENT;
+    void *grown = aligned_alloc(PQUEUE_ALIGNMENT, rounded);
+    if (grown == NULL) return NULL;
+    if (old != NULL) memcpy(grown, old, old_bytes);
+    free(old);
+    return grown;
 }
 
-// Get left child index
-size_t left_child(size_t parent)
+
+// Private helper that makes room for at least cap items in the heap.
+static bool reserve_heap(pqueue *self, size_t cap)
 {
-    assert(parent < PQUEUE_SIZE);
-    return 2*parent + 1;
+    if (cap <= self->capacity) return true;
+    size_t new_cap = self->capacity > 0 ? 2 * self->capacity : 16;
+    while (new_cap < cap) new_cap *= 2;
+
+    // Grow the underlying blocks, which start PQUEUE_PAD slots before index 0
+    vertex_t *keys = aligned_grow(self->keys ? self->keys - PQUEUE_PAD : NULL,
+                                  (self->size + PQUEUE_PAD) * sizeof(vertex_t),
+                                  (new_cap + PQUEUE_PAD) * sizeof(vertex_t));
+    if (keys == NULL) return false;
+    self->keys = keys + PQUEUE_PAD;
+    double *priorities = aligned_grow(self->priorities ? self->priorities - PQUEUE_PAD : NULL,
+                                      (self->size + PQUEUE_PAD) * sizeof(double),
+                                      (new_cap + PQUEUE_PAD) * sizeof(double));
+    if (priorities == NULL) return false;
+    self->priorities = priorities + PQUEUE_PAD;
+    self->capacity = new_cap;
+    return true;
 }
 
-// Get right child index
-size_t right_child(size_t parent)
+
+// Private helper that makes the position index cover the keys 0 ... count-1.
+static bool reserve_keys(pqueue *self, size_t count)
 {
-    assert(parent < PQUEUE_SIZE);
-    return 2*parent + 2;
+    if (count <= self->key_capacity) return true;
+    size_t new_cap = self->key_capacity > 0 ? 2 * self->key_capacity : 16;
+    while (new_cap < count) new_cap *= 2;
+
+    size_t *position = realloc(self->position, new_cap * sizeof(size_t));
+    if (position == NULL) return false;
+    for (size_t i = self->key_capacity; i < new_cap; ++i) position[i] = PQUEUE_ABSENT;
+    self->position = position;
+    self->key_capacity = new_cap;
+    return true;
 }
 
 
 void pqueue_init(pqueue *self)
 {
     self->size = 0;
+    self->capacity = 0;
+    self->keys = NULL;
+    self->priorities = NULL;
+    self->key_capacity = 0;
+    self->position = NULL;
 }
 
 
-// Private helper that allows percolation from any index in the heap
+pqueue* pqueue_reserve(pqueue *self, size_t key_count)
+{
+    if (!reserve_keys(self, key_count) || !reserve_heap(self, key_count)) return NULL;
+    return self;
+}
+
+
+void pqueue_clear(pqueue *self)
+{
+    for (size_t i = 0; i < self->size; ++i) self->position[self->keys[i]] = PQUEUE_ABSENT;
+    self->size = 0;
+}
+
+
+void pqueue_destroy(pqueue *self)
+{
+    if (self->keys != NULL) free(self->keys - PQUEUE_PAD);
+    if (self->priorities != NULL) free(self->priorities - PQUEUE_PAD);
+    free(self->position);
+    pqueue_init(self);
+}
+
+
+// Private helper that places an item at a heap index and records its position
+static void place(pqueue *self, size_t pos, vertex_t key, double priority)
+{
+    self->keys[pos] = key;
+    self->priorities[pos] = priority;
+    self->position[key] = pos;
+}
+
+
+// Private helper that allows percolation from any index in the heap. The item
+// is held aside and parents are shifted down until its slot is found.
 void percolate_up_from(pqueue *self, size_t pos)
 {
-    bool found = false;
-    while ((pos > 0) && !found) // While not at the root
+    vertex_t key = self->keys[pos];
+    double priority = self->priorities[pos];
+    while (pos > 0 && self->priorities[parent(pos)] > priority)
     {
-        if (self->heap[parent(pos)].priority > self->heap[pos].priority)
-        {
-            pqueue_item tmp = self->heap[parent(pos)];
-            self->heap[parent(pos)] = self->heap[pos];
-            self->heap[pos] = tmp;
-            pos = parent(pos);
-        }
-        else // Found the correct location!
-        {
-            found = true;
-        }
+        size_t up = parent(pos);
+        place(self, pos, self->keys[up], self->priorities[up]);
+        pos = up;
     }
+    place(self, pos, key, priority);
 }
 
 
@@ -59,51 +195,56 @@ void percolate_up(pqueue *self) {
 
 pqueue* pqueue_push(pqueue *self, vertex_t key, double priority)
 {
-    if (self->size == PQUEUE_SIZE) return NULL;
-    self->heap[self->size].key = key;
-    self->heap[self->size].priority = priority;
+    if (pqueue_contains(self, key)) return NULL;
+    if (!reserve_keys(self, key + 1) || !reserve_heap(self, self->size + 1)) return NULL;
+    self->keys[self->size] = key;
+    self->priorities[self->size] = priority;
     self->size++;
     percolate_up(self);
     return self;
 }
 
 
-void percolate_down(pqueue *self)
+// Private helper that allows percolation from any index in the heap
+void percolate_down_from(pqueue *self, size_t pos)
 {
-    size_t pos = 0;
-    bool found = false;
-    while (left_child(pos) < self->size && !found) // While pos has a child
+    vertex_t key = self->keys[pos];
+    double priority = self->priorities[pos];
+    while (first_child(pos) < self->size) // While pos has a child
     {
         // Find smallest child
-        size_t child = left_child(pos);
-        if ((child + 1 < self->size) &&
-                (self->heap[child+1].priority < self->heap[child].priority))
-        {
-            child++;
-        }
-
-        // Swap if smallest child is smaller than parent
-        if (self->heap[pos].priority > self->heap[child].priority)
-        {
-            pqueue_item tmp = self->heap[child];
-            self->heap[child] = self->heap[pos];
-            self->heap[pos] = tmp;
-            pos = child;
-        }
-        else // Found the correct location!
-        {
-            found = true;
-        }
+        size_t first = first_child(pos);
+        size_t count = self->size - first;
+        size_t child = first + (count >= PQUEUE_ARITY
+                ? min_child_full(self->priorities + first)
+                : min_child_scalar(self->priorities + first, count));
+
+        // Move the child up if it is smaller than the item
+        if (self->priorities[child] >= priority) break;
+        place(self, pos, self->keys[child], self->priorities[child]);
+        pos = child;
     }
+    place(self, pos, key, priority);
+}
+
+
+void percolate_down(pqueue *self)
+{
+    percolate_down_from(self, 0);
 }
 
 
 pqueue* pqueue_pop(pqueue *self)
 {
     if (pqueue_empty(self)) return NULL;
-    self->heap[0] = self->heap[self->size - 1];
+    self->position[self->keys[0]] = PQUEUE_ABSENT;
     self->size--;
-    percolate_down(self);
+    if (self->size > 0)
+    {
+        self->keys[0] = self->keys[self->size];
+        self->priorities[0] = self->priorities[self->size];
+        percolate_down(self);
+    }
     return self;
 }
 
@@ -111,8 +252,8 @@ pqueue* pqueue_pop(pqueue *self)
 pqueue* pqueue_top(pqueue *self, vertex_t *key, double *priority)
 {
     if (pqueue_empty(self)) return NULL;
-    if (key != NULL) *key = self->heap[0].key;
-    if (priority != NULL) *priority = self->heap[0].priority;
+    if (key != NULL) *key = self->keys[0];
+    if (priority != NULL) *priority = self->priorities[0];
     return self;
 }
 
@@ -128,28 +269,33 @@ bool pqueue_empty(pqueue *self)
     return pqueue_size(self) == 0;
 }
 
+
+bool pqueue_contains(pqueue *self, vertex_t key)
+{
+    return key < self->key_capacity && self->position[key] != PQUEUE_ABSENT;
+}
+
 pqueue* pqueue_adjust_priority(pqueue *self, vertex_t key, double new_priority)
 {
-    size_t i;
-    for (i = 0; i < self->size; ++i) {
-        if (self->heap[i].key == key) {
-            self->heap[i].priority = new_priority;
-            break;
-        }
-    }
-    if (i >= self->size) {
+    if (!pqueue_contains(self, key)) {
       return NULL;
     }
-    percolate_up_from(self, i);
+    size_t i = self->position[key];
+    double old_priority = self->priorities[i];
+    self->priorities[i] = new_priority;
+    if (new_priority < old_priority) {
+        percolate_up_from(self, i);
+    } else {
+        percolate_down_from(self, i);
+    }
     return self;
-    
 }
 
 void pqueue_print(pqueue *self)
 {
     printf("PQueue of size %zu:\n", self->size);
     for (size_t i = 0; i < self->size; ++i) {
-        printf(" %lu [%.3f]", self->heap[i].key, self->heap[i].priority);
+        printf(" %lu [%.3f]", self->keys[i], self->priorities[i]);
     }
     printf("\n");
 }
@@ -5,9 +5,24 @@
  * priorities. The function prototypes in this header file define the API for
  * working with pqueue.
  *
- * Warning: This data structure was created before we knew about malloc, and
- * therefore does some things in different ways. In particular, you will be
- * working directly with pqueue not a pointer.
+ * The heap is indexed: it remembers where every key currently sits, so push,
+ * pop and priority adjustment are all logarithmic with no linear searches. Each
+ * key may be queued at most once.
+ *
+ * There is no fixed size limit. The heap and the position index grow by
+ * doubling as keys are pushed, and pqueue_clear empties the queue while
+ * keeping that memory, so one pqueue can be reused across many searches.
+ * Keys and priorities are kept in separate 64-byte aligned arrays, so the
+ * comparisons made while percolating read contiguous doubles.
+ *
+ * The heap is d-ary, with the arity fixed at compile time by PQUEUE_ARITY
+ * (e.g. -DPQUEUE_ARITY=8; 2 gives a binary heap). The arrays are offset so
+ * that the children of every node start on a multiple of PQUEUE_ARITY, which
+ * puts all of them in one cache line for arities up to 8, and the smallest
+ * child is found with SSE2/AVX when the compiler targets them.
+ *
+ * Note: you work directly with a pqueue, not a pointer, but it owns heap
+ * memory and must be released with pqueue_destroy.
  *
  * @author Michael J. Bannister
  * @date 03 Dec 2015
@@ -19,17 +34,18 @@
 #include<stdbool.h>
 #include<assert.h>
 
-#define PQUEUE_SIZE 1000
 typedef unsigned long vertex_t;
 
-/*
- * Struct for holding an association of a key and a priority.
- */
-typedef struct pqueue_item
-{
-    vertex_t key;
-    double priority;
-} pqueue_item;
+// Position recorded for keys that are not in the heap.
+#define PQUEUE_ABSENT ((size_t)-1)
+
+// Alignment of the heap arrays, one cache line.
+#define PQUEUE_ALIGNMENT 64
+
+// Number of children of every heap node.
+#ifndef PQUEUE_ARITY
+#define PQUEUE_ARITY 4
+#endif
 
 /**
  * Struct that is the actual priority queue "object".
@@ -37,26 +53,65 @@ typedef struct pqueue_item
 typedef struct pqueue
 {
     size_t size;
-    pqueue_item heap[PQUEUE_SIZE];
+    size_t capacity;       // allocated length of keys and priorities
+    vertex_t *keys;        // keys in heap order
+    double *priorities;    // priorities in heap order
+    size_t key_capacity;   // allocated length of position
+    size_t *position;      // heap index of every key, or PQUEUE_ABSENT
 } pqueue;
 
 
 /**
- * @brief Initializes a new empty pqueue.
+ * @brief Initializes a new empty pqueue. No memory is allocated until the
+ * first push.
  *
  * @param self a pointer to the pqueue
  */
 void pqueue_init(pqueue *self);
 
 
+/**
+ * @brief Grows a pqueue so that it can hold the keys 0 ... key_count-1
+ * without further allocation.
+ *
+ * Time: O(key_count)
+ *
+ * @param self a pointer to the pqueue
+ * @param key_count one more than the largest key that will be pushed
+ * @return self or NULL if memory allocation failed
+ */
+pqueue* pqueue_reserve(pqueue *self, size_t key_count);
+
+
+/**
+ * @brief Removes every item but keeps the allocated memory for reuse.
+ *
+ * Time: O(n)
+ *
+ * @param self a pointer to the pqueue
+ */
+void pqueue_clear(pqueue *self);
+
+
+/**
+ * @brief Frees the memory owned by a pqueue.
+ *
+ * @param self a pointer to the pqueue
+ */
+void pqueue_destroy(pqueue *self);
+
+
 /**
  * @brief Adds an item to the pqueue with the given key and priority.
  *
+ * Time: O(log_d n) amortized
+ *
  * @param self a pointer to the pqueue
  * @param key the key to add
  * @param priority the priority of the key
- * @pre the current size of pqueue is less than PQUEUE_SIZE
- * @return self if preconditions are met and NULL otherwise
+ * @pre key is not already in the pqueue
+ * @return self if preconditions are met and NULL otherwise, including when
+ *         memory allocation failed
  * @post the item (key, priority) is added to pqueue
  */
 pqueue* pqueue_push(pqueue *self, vertex_t key, double priority);
@@ -65,6 +120,8 @@ pqueue* pqueue_push(pqueue *self, vertex_t key, double priority);
 /**
  * @brief Removes the item with lowest priority.
  *
+ * Time: O(d log_d n)
+ *
  * @param self a pointer to the pqueue
  * @pre the current size of pqueue is non-empty
  * @return self if preconditions are met and NULL otherwise
@@ -104,11 +161,24 @@ size_t pqueue_size(pqueue *self);
  */
 bool pqueue_empty(pqueue *self);
 
+/**
+ * @brief Determines whether a key is currently in the pqueue.
+ *
+ * Time: O(1)
+ *
+ * @param self a pointer to the pqueue
+ * @param key the key to look for
+ * @return true if key is queued and false otherwise
+ */
+bool pqueue_contains(pqueue *self, vertex_t key);
+
 /**
  *
  * @brief Adjusts the priority of an item in the queue.
  *
- * Note: this searches the queue for the item, so it's O(n)
+ * Time: O(log_d n) for a decrease and O(d log_d n) for an increase. The item
+ * is found through the position index, and may move towards the top or the
+ * bottom of the heap.
  * If the given vertex doesn't exist in the heap, this function returns NULL
  * instead of the adjusted queue.
  *
@@ -1,35 +1,38 @@
 #include "queue.h"
+#include <stdint.h>
 
-typedef struct queue_node queue_node;
+#define QUEUE_MIN_CAPACITY 16
 
+// A ring buffer: the count elements from slot head onwards, wrapping around
+// at capacity, which is zero or a power of two.
 struct queue {
     size_t count;
-    queue_node* head;
-    queue_node* tail;
+    size_t head;
+    size_t capacity;
+    vertex_t* data;
 };
 
-// Internal nodes used by queue
-struct queue_node {
-    vertex_t data;
-    queue_node* next;
-    queue_node* prev;
-};
+// Private helper that moves the elements into a buffer of at least cap
+// slots, unwrapped so that the first one is in slot 0.
+static queue* queue_grow(queue* self, size_t cap) {
+    size_t new_capacity = self->capacity > 0 ? self->capacity : QUEUE_MIN_CAPACITY;
+    while (new_capacity < cap) {
+        if (new_capacity > SIZE_MAX / 2) { return NULL; }
+        new_capacity *= 2;
+    }
+    if (new_capacity == self->capacity) { return self; }
+    if (new_capacity > SIZE_MAX / sizeof(vertex_t)) { return NULL; }
 
-// Private helper method for creating a queue_node
-queue_node* queue_node_create(
-  vertex_t data,
-  queue_node* prev,
-  queue_node* next
-) {
-    // Allocate
-    queue_node* node = malloc(sizeof(queue_node));
-    if (node == NULL) { return NULL; }
-    // Initialize
-    node->data = data;
-    node->prev = prev;
-    node->next = next;
-    // Return
-    return node;
+    vertex_t* data = malloc(new_capacity * sizeof(vertex_t));
+    if (data == NULL) { return NULL; }
+    for (size_t i = 0; i < self->count; i++) {
+        data[i] = self->data[(self->head + i) & (self->capacity - 1)];
+    }
+    free(self->data);
+    self->data = data;
+    self->head = 0;
+    self->capacity = new_capacity;
+    return self;
 }
 
 queue* queue_create() {
@@ -38,52 +41,39 @@ queue* queue_create() {
     if (new_list == NULL) { return NULL; }
     // Initialize
     new_list->count = 0;
-    new_list->head = NULL;
-    new_list->tail = NULL;
+    new_list->head = 0;
+    new_list->capacity = 0;
+    new_list->data = NULL;
     // Return
     return new_list;
 }
 
 void queue_destroy(queue* self) {
-    // Free all nodes
-    queue_node* finger = self->head;
-    while (finger != NULL) {
-        queue_node* temp = finger;
-        finger = finger->next;
-        free(temp);
-    }
-    // Free the queue
+    free(self->data);
     free(self);
 }
 
+queue* queue_reserve(queue* self, size_t capacity) {
+    return capacity <= self->capacity ? self : queue_grow(self, capacity);
+}
+
 queue* queue_get_first(queue* self, vertex_t* value) {
-    if (self->head == NULL) { return NULL; }
-    *value = self->head->data;
+    if (self->count == 0) { return NULL; }
+    *value = self->data[self->head];
     return self;
 }
 
 queue* queue_add_last(queue* self, vertex_t value) {
-    queue_node* node = queue_node_create(value, self->tail, NULL);
-    if (node == NULL) { return NULL; }
-
-    if (self->head == NULL) { self->head = node; }
-    if (self->tail != NULL) { self->tail->next = node; }
-    self->tail = node;
+    if (self->count == self->capacity && queue_grow(self, self->count + 1) == NULL) { return NULL; }
+    self->data[(self->head + self->count) & (self->capacity - 1)] = value;
     self->count++;
     return self;
 }
 
 queue* queue_remove_first(queue* self) {
-    if (self->head == NULL) { return NULL; }
-    queue_node* temp = self->head;
-    self->head = self->head->next;
-    if (self->head == NULL) {
-        self->tail = NULL;
-    } else {
-        self->head->prev = NULL;
-    }
+    if (self->count == 0) { return NULL; }
+    self->head = (self->head + 1) & (self->capacity - 1);
     self->count--;
-    free(temp);
     return self;
 }
 
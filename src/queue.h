@@ -1,6 +1,7 @@
 /**
- * This file provides a queue based on a double linked list. This is the same
- * queue we used in lab.
+ * This file provides a queue of vertices in a growable ring buffer. Elements
+ * live in one array that doubles when full, so adding and removing them does
+ * not allocate, and a queue reserved for all its elements never does.
  */
 #ifndef __QUEUE_H__
 #define __QUEUE_H__
@@ -35,6 +36,19 @@ queue* queue_create();
  */
 void queue_destroy(queue* self);
 
+/**
+ * Grows a queue so that it can hold capacity elements without further
+ * allocation.
+ *
+ * Time: O(capacity)
+ *
+ * @param self the queue
+ * @param capacity the number of elements it should hold
+ * @return self or NULL if memory allocation failed or capacity elements
+ *         would not fit in memory
+ */
+queue* queue_reserve(queue* self, size_t capacity);
+
 /**
  * Gets the value of the first element in the queue.
  *
@@ -50,8 +64,7 @@ queue* queue_get_first(queue* self, vertex_t* value);
 /**
  * Adds an element to the back of the list.
  *
- * Time: O(n)
- * Note: This is O(1) for a double queue.
+ * Time: O(1) amortized, O(1) when the queue was reserved for it
  *
  * @param self the queue
  * @param value the value being added
@@ -0,0 +1,137 @@
+#include "rheap.h"
+
+// Private helper that converts a priority to fixed point, rounding down so
+// that the conversion preserves the order of non-negative priorities.
+static uint64_t scale(double priority)
+{
+    double scaled = priority * RHEAP_SCALE;
+    if (scaled >= 18446744073709551615.0) return UINT64_MAX;
+    return (uint64_t)scaled;
+}
+
+
+// Private helper giving the bucket of a fixed point priority: 0 when it equals
+// the last popped priority, and otherwise one more than the index of the
+// highest bit in which the two differ.
+static size_t bucket_of(rheap *self, uint64_t scaled)
+{
+    if (scaled == self->last) return 0;
+    return 64 - (size_t)__builtin_clzll(scaled ^ self->last);
+}
+
+
+// Private helper that appends an item to a bucket.
+static bool bucket_add(rheap_bucket *bucket, rheap_item item)
+{
+    if (bucket->size == bucket->capacity)
+    {
+        size_t new_cap = bucket->capacity > 0 ? 2 * bucket->capacity : 16;
+        rheap_item *items = realloc(bucket->items, new_cap * sizeof(rheap_item));
+        if (items == NULL) return false;
+        bucket->items = items;
+        bucket->capacity = new_cap;
+    }
+    bucket->items[bucket->size++] = item;
+    return true;
+}
+
+
+void rheap_init(rheap *self)
+{
+    self->size = 0;
+    self->last = 0;
+    for (size_t i = 0; i < RHEAP_BUCKETS; ++i)
+    {
+        self->buckets[i].size = 0;
+        self->buckets[i].capacity = 0;
+        self->buckets[i].items = NULL;
+    }
+}
+
+
+void rheap_clear(rheap *self)
+{
+    self->size = 0;
+    self->last = 0;
+    for (size_t i = 0; i < RHEAP_BUCKETS; ++i) self->buckets[i].size = 0;
+}
+
+
+void rheap_destroy(rheap *self)
+{
+    for (size_t i = 0; i < RHEAP_BUCKETS; ++i) free(self->buckets[i].items);
+    rheap_init(self);
+}
+
+
+rheap* rheap_push(rheap *self, vertex_t key, double priority)
+{
+    if (!(priority >= 0.0)) return NULL;
+    rheap_item item = { key, priority, scale(priority) };
+    if (item.scaled < self->last) return NULL;
+    if (!bucket_add(&self->buckets[bucket_of(self, item.scaled)], item)) return NULL;
+    self->size++;
+    return self;
+}
+
+
+// Private helper that refills bucket 0 when it is empty. The lowest non-empty
+// bucket is emptied into lower buckets after making its minimum the new last
+// priority; every item of that bucket lands strictly lower, and the minimum
+// lands in bucket 0. Returns false if the heap is empty or memory ran out,
+// after which the heap should only be destroyed.
+static bool refill(rheap *self)
+{
+    if (self->buckets[0].size > 0) return true;
+
+    size_t i = 1;
+    while (i < RHEAP_BUCKETS && self->buckets[i].size == 0) i++;
+    if (i == RHEAP_BUCKETS) return false;
+
+    rheap_bucket *bucket = &self->buckets[i];
+    uint64_t least = bucket->items[0].scaled;
+    for (size_t j = 1; j < bucket->size; ++j)
+    {
+        if (bucket->items[j].scaled < least) least = bucket->items[j].scaled;
+    }
+    self->last = least;
+
+    while (bucket->size > 0)
+    {
+        rheap_item item = bucket->items[bucket->size - 1];
+        if (!bucket_add(&self->buckets[bucket_of(self, item.scaled)], item)) return false;
+        bucket->size--;
+    }
+    return true;
+}
+
+
+rheap* rheap_pop(rheap *self)
+{
+    if (rheap_empty(self) || !refill(self)) return NULL;
+    self->buckets[0].size--;
+    self->size--;
+    return self;
+}
+
+
+rheap* rheap_top(rheap *self, vertex_t *key, double *priority)
+{
+    if (rheap_empty(self) || !refill(self)) return NULL;
+    rheap_bucket *bucket = &self->buckets[0];
+    if (key != NULL) *key = bucket->items[bucket->size - 1].key;
+    if (priority != NULL) *priority = bucket->items[bucket->size - 1].priority;
+    return self;
+}
+
+
+size_t rheap_size(rheap *self)
+{
+    return self->size;
+}
+
+
+bool rheap_empty(rheap *self)
+{
+    return rheap_size(self) == 0;
+}
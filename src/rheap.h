@@ -0,0 +1,158 @@
+/**
+ * @file rheap.h
+ *
+ * A radix heap: a monotone priority queue of vertex_t keys and non-negative
+ * double priorities, with the same push/pop/top interface as pqueue.
+ *
+ * Priorities are converted to fixed point (multiplied by RHEAP_SCALE and
+ * rounded down) and kept in 65 buckets according to the highest bit in which
+ * they differ from the last popped priority. Every item is moved between
+ * buckets at most 64 times, so push is O(1) and pop is O(1) amortized, with no
+ * comparisons against the rest of the queue.
+ *
+ * This only works for monotone use: a pushed priority may never be below the
+ * last popped one, which is the case for the tentative distances in
+ * Dijkstra's algorithm. There is no decrease-key; push the key again with the
+ * smaller priority and skip stale copies when they are popped. Items whose
+ * priorities agree to within 1/RHEAP_SCALE may be popped in either order.
+ *
+ * Note: as with pqueue, you work directly with an rheap, not a pointer, and
+ * it must be released with rheap_destroy.
+ */
+#ifndef __RHEAP_H__
+#define __RHEAP_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef unsigned long vertex_t;
+
+// Fixed point units per unit of priority (mile or hour).
+#ifndef RHEAP_SCALE
+#define RHEAP_SCALE 1e9
+#endif
+
+// One bucket for an exact match with the last popped priority, plus one per bit.
+#define RHEAP_BUCKETS 65
+
+/*
+ * Struct for holding a key, its priority and its fixed point priority.
+ */
+typedef struct rheap_item
+{
+    vertex_t key;
+    double priority;
+    uint64_t scaled;
+} rheap_item;
+
+/*
+ * A growable array of items.
+ */
+typedef struct rheap_bucket
+{
+    size_t size;
+    size_t capacity;
+    rheap_item *items;
+} rheap_bucket;
+
+/**
+ * Struct that is the actual radix heap "object".
+ */
+typedef struct rheap
+{
+    size_t size;
+    uint64_t last;        // fixed point priority of the last pop
+    rheap_bucket buckets[RHEAP_BUCKETS];
+} rheap;
+
+
+/**
+ * @brief Initializes a new empty rheap. No memory is allocated until the
+ * first push.
+ *
+ * @param self a pointer to the rheap
+ */
+void rheap_init(rheap *self);
+
+
+/**
+ * @brief Removes every item but keeps the allocated memory for reuse.
+ *
+ * Time: O(1)
+ *
+ * @param self a pointer to the rheap
+ */
+void rheap_clear(rheap *self);
+
+
+/**
+ * @brief Frees the memory owned by an rheap.
+ *
+ * @param self a pointer to the rheap
+ */
+void rheap_destroy(rheap *self);
+
+
+/**
+ * @brief Adds an item to the rheap with the given key and priority.
+ *
+ * Time: O(1) amortized
+ *
+ * @param self a pointer to the rheap
+ * @param key the key to add
+ * @param priority the priority of the key
+ * @pre priority is not below the priority of the last popped item
+ * @return self if preconditions are met and NULL otherwise, including when
+ *         memory allocation failed
+ */
+rheap* rheap_push(rheap *self, vertex_t key, double priority);
+
+
+/**
+ * @brief Removes the item with lowest priority.
+ *
+ * Time: O(1) amortized
+ *
+ * @param self a pointer to the rheap
+ * @pre the current size of rheap is non-empty
+ * @return self if preconditions are met and NULL otherwise
+ */
+rheap* rheap_pop(rheap *self);
+
+
+/**
+ * @brief Returns the key and priority of the item with lowest priority.
+ *
+ * Note: output parameters may be NULL if the caller does not need this output.
+ *
+ * Time: O(1) amortized. This may redistribute a bucket, which is why self is
+ * not const.
+ *
+ * @param self a pointer to the rheap
+ * @param[out] key a pointer to return the key to
+ * @param[out] priority a pointer to return the priority to
+ * @pre the current size of rheap is non-empty
+ * @return self if preconditions are met and NULL otherwise
+ */
+rheap* rheap_top(rheap *self, vertex_t *key, double *priority);
+
+
+/**
+ * @brief Returns the number of items in the rheap, counting stale copies.
+ *
+ * @param self a pointer to the rheap
+ * @return the number of items in rheap
+ */
+size_t rheap_size(rheap *self);
+
+
+/**
+ * @brief Returns the emptiness of rheap.
+ *
+ * @param self a pointer to the rheap
+ * @return true if the rheap is empty and false otherwise
+ */
+bool rheap_empty(rheap *self);
+
+#endif//__RHEAP_H__
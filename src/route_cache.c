@@ -0,0 +1,274 @@
+// Implementations of the function declarations in route_cache.h.
+#include "route_cache.h"
+#include <pthread.h>
+#include <string.h>
+
+#define ROUTE_CACHE_MIN_BUCKETS 16
+
+// A cached route. Each route is one allocation, its path stored after it.
+typedef struct route_entry {
+    vertex_t start;
+    vertex_t end;
+    char type;
+    size_t length;                // vertices in path
+    double distance;
+    double time;
+    size_t hash;
+    struct route_entry* next;     // the next route in the same bucket
+    struct route_entry* newer;    // neighbours in the least recently used list
+    struct route_entry* older;
+    vertex_t path[];
+} route_entry;
+
+// One independently locked part of a cache: a chained hash table of routes
+// threaded onto a list from most to least recently used.
+typedef struct route_shard {
+    pthread_mutex_t lock;
+    route_entry** buckets;
+    size_t bucket_count;          // a power of two
+    route_entry* newest;
+    route_entry* oldest;
+    size_t version;               // of the map the routes were computed on
+    size_t routes;
+    size_t bytes;                 // held by the routes, not the table
+    size_t capacity;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t invalidations;
+} route_shard;
+
+struct route_cache {
+    graph* G;
+    route_shard shards[ROUTE_CACHE_SHARDS];
+};
+
+// Private helper mixing a trip into a hash; the top bits pick the shard and
+// the bottom bits the bucket.
+static size_t route_hash(vertex_t start, vertex_t end, char type) {
+    unsigned long long h = (unsigned long long)start * 2 + (type == 'T');
+    h = (h * 0x9E3779B97F4A7C15ull) ^ ((unsigned long long)end * 0xC2B2AE3D27D4EB4Full);
+    h ^= h >> 29;
+    return (size_t)h;
+}
+
+// Private helper returning the shard a hash belongs to.
+static route_shard* shard_of(route_cache* self, size_t hash) {
+    return &self->shards[(hash >> 27) % ROUTE_CACHE_SHARDS];
+}
+
+// Private helper returning the bytes a route of the given length takes up.
+static size_t entry_size(size_t length) {
+    return sizeof(route_entry) + length * sizeof(vertex_t);
+}
+
+// Private helper that takes a route off the least recently used list.
+static void unlink_entry(route_shard* S, route_entry* e) {
+    if (e->newer != NULL) e->newer->older = e->older; else S->newest = e->older;
+    if (e->older != NULL) e->older->newer = e->newer; else S->oldest = e->newer;
+}
+
+// Private helper that puts a route at the front of the least recently used
+// list.
+static void push_newest(route_shard* S, route_entry* e) {
+    e->newer = NULL;
+    e->older = S->newest;
+    if (S->newest != NULL) S->newest->newer = e; else S->oldest = e;
+    S->newest = e;
+}
+
+// Private helper returning the bucket link that points at the route of a
+// trip, or at the NULL ending its bucket if it is not cached.
+static route_entry** find(route_shard* S, size_t hash, vertex_t start, vertex_t end, char type) {
+    route_entry** link = &S->buckets[hash & (S->bucket_count - 1)];
+    while (*link != NULL) {
+        route_entry* e = *link;
+        if (e->hash == hash && e->start == start && e->end == end && e->type == type) { break; }
+        link = &e->next;
+    }
+    return link;
+}
+
+// Private helper that drops the least recently used route of a shard.
+static void evict_oldest(route_shard* S) {
+    route_entry* e = S->oldest;
+    route_entry** link = find(S, e->hash, e->start, e->end, e->type);
+    *link = e->next;
+    unlink_entry(S, e);
+    S->routes--;
+    S->bytes -= entry_size(e->length);
+    S->evictions++;
+    free(e);
+}
+
+// Private helper that forgets every route of a shard computed on an older
+// version of the map.
+static void check_version(route_cache* self, route_shard* S) {
+    size_t version = graph_version(self->G);
+    if (S->version == version) { return; }
+
+    route_entry* e = S->newest;
+    while (e != NULL) {
+        route_entry* older = e->older;
+        free(e);
+        e = older;
+    }
+    memset(S->buckets, 0, S->bucket_count * sizeof(route_entry*));
+    S->newest = NULL;
+    S->oldest = NULL;
+    S->invalidations += S->routes;
+    S->routes = 0;
+    S->bytes = 0;
+    S->version = version;
+}
+
+// Private helper that doubles the buckets of a shard once it holds more
+// routes than buckets. The table stays as it is if there is no memory.
+static void grow(route_shard* S) {
+    if (S->routes <= S->bucket_count) { return; }
+    size_t count = S->bucket_count * 2;
+    route_entry** buckets = calloc(count, sizeof(route_entry*));
+    if (buckets == NULL) { return; }
+    for (size_t b = 0; b < S->bucket_count; b++) {
+        route_entry* e = S->buckets[b];
+        while (e != NULL) {
+            route_entry* next = e->next;
+            e->next = buckets[e->hash & (count - 1)];
+            buckets[e->hash & (count - 1)] = e;
+            e = next;
+        }
+    }
+    free(S->buckets);
+    S->buckets = buckets;
+    S->bucket_count = count;
+}
+
+route_cache* route_cache_create(graph* G, size_t capacity) {
+    route_cache* self = calloc(1, sizeof(route_cache));
+    if (self == NULL) { return NULL; }
+    self->G = G;
+
+    size_t s = 0;
+    for (; s < ROUTE_CACHE_SHARDS; s++) {
+        route_shard* S = &self->shards[s];
+        S->buckets = calloc(ROUTE_CACHE_MIN_BUCKETS, sizeof(route_entry*));
+        if (S->buckets == NULL || pthread_mutex_init(&S->lock, NULL) != 0) {
+            free(S->buckets);
+            break;
+        }
+        S->bucket_count = ROUTE_CACHE_MIN_BUCKETS;
+        S->capacity = capacity / ROUTE_CACHE_SHARDS;
+        S->version = graph_version(G);
+    }
+    if (s < ROUTE_CACHE_SHARDS) {
+        while (s-- > 0) {
+            pthread_mutex_destroy(&self->shards[s].lock);
+            free(self->shards[s].buckets);
+        }
+        free(self);
+        return NULL;
+    }
+    return self;
+}
+
+void route_cache_destroy(route_cache* self) {
+    for (size_t s = 0; s < ROUTE_CACHE_SHARDS; s++) {
+        route_shard* S = &self->shards[s];
+        route_entry* e = S->newest;
+        while (e != NULL) {
+            route_entry* older = e->older;
+            free(e);
+            e = older;
+        }
+        pthread_mutex_destroy(&S->lock);
+        free(S->buckets);
+    }
+    free(self);
+}
+
+bool route_cache_get(route_cache* self, vertex_t start, vertex_t end, char type,
+        vertex_t* path, size_t* length, double* distance, double* time) {
+    size_t hash = route_hash(start, end, type);
+    route_shard* S = shard_of(self, hash);
+    pthread_mutex_lock(&S->lock);
+    check_version(self, S);
+    route_entry* e = *find(S, hash, start, end, type);
+    if (e != NULL) {
+        unlink_entry(S, e);
+        push_newest(S, e);
+        // copied under the lock, since another thread may evict it after
+        memcpy(path, e->path, e->length * sizeof(vertex_t));
+        *length = e->length;
+        *distance = e->distance;
+        *time = e->time;
+        S->hits++;
+    } else {
+        S->misses++;
+    }
+    pthread_mutex_unlock(&S->lock);
+    return e != NULL;
+}
+
+bool route_cache_put(route_cache* self, vertex_t start, vertex_t end, char type,
+        const vertex_t* path, size_t length, double distance, double time) {
+    size_t hash = route_hash(start, end, type);
+    route_shard* S = shard_of(self, hash);
+    size_t size = entry_size(length);
+    if (size > S->capacity) { return false; }
+
+    // allocated and filled before taking the lock, which is then held only
+    // to link it in
+    route_entry* e = malloc(size);
+    if (e == NULL) { return false; }
+    e->start = start;
+    e->end = end;
+    e->type = type;
+    e->length = length;
+    e->distance = distance;
+    e->time = time;
+    e->hash = hash;
+    memcpy(e->path, path, length * sizeof(vertex_t));
+
+    pthread_mutex_lock(&S->lock);
+    check_version(self, S);
+    route_entry** link = find(S, hash, start, end, type);
+    if (*link != NULL) { // another thread cached it first
+        unlink_entry(S, *link);
+        push_newest(S, *link);
+        pthread_mutex_unlock(&S->lock);
+        free(e);
+        return true;
+    }
+    while (S->bytes + size > S->capacity) {
+        evict_oldest(S);
+    }
+    // evicting may have emptied the bucket link points into, so look again
+    link = find(S, hash, start, end, type);
+    e->next = NULL;
+    *link = e;
+    push_newest(S, e);
+    S->routes++;
+    S->bytes += size;
+    grow(S);
+    pthread_mutex_unlock(&S->lock);
+    return true;
+}
+
+route_cache_usage route_cache_stats(route_cache* self) {
+    route_cache_usage usage;
+    memset(&usage, 0, sizeof(usage));
+    for (size_t s = 0; s < ROUTE_CACHE_SHARDS; s++) {
+        route_shard* S = &self->shards[s];
+        pthread_mutex_lock(&S->lock);
+        usage.hits += S->hits;
+        usage.misses += S->misses;
+        usage.routes += S->routes;
+        usage.evictions += S->evictions;
+        usage.invalidations += S->invalidations;
+        usage.bytes += S->bytes + S->bucket_count * sizeof(route_entry*);
+        usage.capacity += S->capacity;
+        pthread_mutex_unlock(&S->lock);
+    }
+    usage.bytes += sizeof(route_cache);
+    return usage;
+}
@@ -0,0 +1,110 @@
+/**
+ * This header provides a bounded cache of computed routes.
+ *
+ * A route is the path of a trip with its total distance and time, keyed by
+ * start, end and trip type. The cache holds at most a given number of bytes
+ * of routes, dropping the least recently used one to make room, and may be
+ * used from several threads at once.
+ *
+ * The cache is split into ROUTE_CACHE_SHARDS shards by a hash of the key,
+ * each with its own lock, least recently used list and share of the budget,
+ * so threads answering different trips rarely wait on each other. Every
+ * shard remembers the version of the map its routes were computed on, and
+ * forgets them all the first time it is used after the map changed.
+ */
+#ifndef __ROUTE_CACHE_H__
+#define __ROUTE_CACHE_H__
+
+#include "graph.h"
+
+// Number of independently locked parts of a cache.
+#define ROUTE_CACHE_SHARDS 16
+
+/**
+ * What a route cache has done since it was created.
+ */
+typedef struct route_cache_usage
+{
+    size_t hits;          // lookups that found their route
+    size_t misses;        // lookups that did not
+    size_t routes;        // routes held now
+    size_t evictions;     // routes dropped to make room
+    size_t invalidations; // routes dropped because the map changed
+    size_t bytes;         // memory held now, hash tables included
+    size_t capacity;      // most memory the routes may hold
+} route_cache_usage;
+
+/**
+ * Forward declared route cache struct, hiding implementation details.
+ */
+typedef struct route_cache route_cache;
+
+/**
+ * Creates an empty route cache.
+ *
+ * @param  G        the map the routes are computed on
+ * @param  capacity the most bytes the routes may take up, shared evenly by
+ *                  the shards
+ * @return          the cache, or NULL if memory allocation failed
+ */
+route_cache* route_cache_create(graph* G, size_t capacity);
+
+/**
+ * Frees all memory associated with a route cache.
+ *
+ * @param self the cache being deallocated
+ */
+void route_cache_destroy(route_cache* self);
+
+/**
+ * Looks up the route of a trip and marks it most recently used.
+ *
+ * Runtime: O(length of the route) expected
+ *
+ * @param  self     the cache
+ * @param  start    the start of the trip
+ * @param  end      the end of the trip
+ * @param  type     'D' or 'T'
+ * @param  path     filled with the vertices of the route from start to end;
+ *                  must hold as many vertices as the map has
+ * @param  length   set to the number of vertices in path
+ * @param  distance set to the total distance of the route
+ * @param  time     set to the total time of the route in hours
+ * @return          true if the route was cached, false otherwise, in which
+ *                  case nothing is written
+ */
+bool route_cache_get(route_cache* self, vertex_t start, vertex_t end, char type,
+        vertex_t* path, size_t* length, double* distance, double* time);
+
+/**
+ * Stores the route of a trip as the most recently used, dropping the least
+ * recently used routes until it fits. A route bigger than a shard's share of
+ * the capacity is not stored, nor is one already there replaced.
+ *
+ * Runtime: O(length of the route) expected
+ *
+ * @param  self     the cache
+ * @param  start    the start of the trip
+ * @param  end      the end of the trip
+ * @param  type     'D' or 'T'
+ * @param  path     the vertices of the route from start to end
+ * @param  length   the number of vertices in path
+ * @param  distance the total distance of the route
+ * @param  time     the total time of the route in hours
+ * @return          true if the route is cached, false if it did not fit or
+ *                  memory allocation failed
+ */
+bool route_cache_put(route_cache* self, vertex_t start, vertex_t end, char type,
+        const vertex_t* path, size_t length, double distance, double time);
+
+/**
+ * Returns what a route cache has done so far.
+ *
+ * Runtime: O(ROUTE_CACHE_SHARDS)
+ *
+ * @param  self the cache
+ * @return      its hits, misses and memory use
+ */
+route_cache_usage route_cache_stats(route_cache* self);
+
+#endif//__ROUTE_CACHE_H__